@@ -19,6 +19,8 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "mem_pool.h" // list.h allocates nodes from the pools
+#include "list.h"
 #include "gl_renderable.h"
 
 /*
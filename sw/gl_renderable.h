@@ -53,8 +53,10 @@ struct GLVertexDataStr {
 
 /**
  * Specifies common renderable object for GLRenderer to draw.
+ * The links of the rendering list live in the object itself (ListHook),
+ * so a renderable can be in one GLRenderer at a time.
  */
-class GLRenderable {
+class GLRenderable : public ListHook< GLRenderable > {
 private:
     uint64_t m_Id;
 
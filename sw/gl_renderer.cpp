@@ -47,13 +47,13 @@ void GLRenderer::init() {
  */
 void GLRenderer::cleanup() {
 
-    Node< GLRenderable* >* node_ptr = m_Renderables.begin();
+    GLRenderable* renderable_ptr = m_Renderables.begin();
 
     // Delete buffers of all the renderables
-    while( node_ptr != NULL ) {
-        GLuint id = node_ptr->item()->getVertexDataRef().buffer_id;
+    while( renderable_ptr != NULL ) {
+        GLuint id = renderable_ptr->getVertexDataRef().buffer_id;
         glDeleteBuffers( 1, &id );
-        node_ptr = node_ptr->next();
+        renderable_ptr = m_Renderables.next( renderable_ptr );
     }
     // Delete VAO
     glDeleteVertexArrays( 1, &m_VertexArrayId );
@@ -79,16 +79,16 @@ void GLRenderer::addRenderable( GLRenderable* renderable_ptr ) {
  */
 void GLRenderer::removeRenderable( uint64_t id ) {
 
-    Node< GLRenderable* >* node_ptr = m_Renderables.begin();
+    GLRenderable* renderable_ptr = m_Renderables.begin();
 
-    while( node_ptr != NULL ) {
-        if( node_ptr->item()->getId() == id ) {
-            GLuint id = node_ptr->item()->getVertexDataRef().buffer_id;
+    while( renderable_ptr != NULL ) {
+        if( renderable_ptr->getId() == id ) {
+            GLuint id = renderable_ptr->getVertexDataRef().buffer_id;
             glDeleteBuffers( 1, &id );
-            m_Renderables.remove( node_ptr );
+            m_Renderables.remove( renderable_ptr );
             break;
         }
-        node_ptr = node_ptr->next();
+        renderable_ptr = m_Renderables.next( renderable_ptr );
     }
 }
 
@@ -97,41 +97,16 @@ void GLRenderer::removeRenderable( uint64_t id ) {
  */
 bool GLRenderer::loadShaders( const char* v_shader, const char* f_shader ) {
 
-    char* v_buf_ptr = NULL;
-    char* f_buf_ptr = NULL;
-    FILE* fp = NULL;
+    // Sources and info logs live in m_LoadStack until we return
+    StackScope scope( m_LoadStack );
 
-    // Read vertex shader source into v_buf_ptr
-    unsigned int size = 0;
-    fp = fopen( v_shader, "r" );
-    if( fp != NULL ) {
-        // count size manually, as SEEK_END doesn't find the EOF properly
-        // for some reason when debugging code
-        while( getc( fp ) != EOF ) { ++size; }
-        fseek( fp, 0, SEEK_SET );
-        v_buf_ptr = new char[ size + 1 ];
-        fread( v_buf_ptr, size, 1, fp );
-        v_buf_ptr[ size ] = '\0';
-        fclose( fp );
-    }
-
-    // Read fragment shader source into f_buf_ptr
-    size = 0;
-    fp = fopen( f_shader, "r" );
-    if( fp != NULL ) {
-        while( getc( fp ) != EOF ) { ++size; }
-        fseek( fp, 0, SEEK_SET );
-        f_buf_ptr = new char[ size + 1 ];
-        fread( f_buf_ptr, size, 1, fp );
-        f_buf_ptr[ size ] = '\0';
-        fclose( fp );
-    }
+    // Read vertex and fragment shader sources
+    char* v_buf_ptr = loadTextFile( v_shader );
+    char* f_buf_ptr = loadTextFile( f_shader );
 
     if( v_buf_ptr == NULL || f_buf_ptr == NULL ) {
         // Could not load shaders, return immediately.
         fprintf( stderr, "Failed to load shaders\n" );
-        if( v_buf_ptr != NULL ) delete[] v_buf_ptr;
-        if( f_buf_ptr != NULL ) delete[] f_buf_ptr;
         return false;
     }
 
@@ -152,9 +127,13 @@ bool GLRenderer::loadShaders( const char* v_shader, const char* f_shader ) {
     // Check Vertex Shader
     glGetShaderiv( v_shader_id, GL_COMPILE_STATUS, &compile_status );
     glGetShaderiv( v_shader_id, GL_INFO_LOG_LENGTH, &info_log_len );
-    char v_shader_err_msg[ info_log_len ];
-    glGetShaderInfoLog( v_shader_id, info_log_len, NULL, v_shader_err_msg );
-    fprintf( stdout, "%s\n", v_shader_err_msg );
+    if( info_log_len > 1 ) {
+        char* v_shader_err_msg = ( char* )m_LoadStack.alloc( info_log_len, 1 );
+        if( v_shader_err_msg != NULL ) {
+            glGetShaderInfoLog( v_shader_id, info_log_len, NULL, v_shader_err_msg );
+            fprintf( stdout, "%s\n", v_shader_err_msg );
+        }
+    }
 
     // Compile Fragment Shader
     printf( "Compiling shader : %s\n", f_shader );
@@ -164,9 +143,13 @@ bool GLRenderer::loadShaders( const char* v_shader, const char* f_shader ) {
     // Check Fragment Shader
     glGetShaderiv( f_shader_id, GL_COMPILE_STATUS, &compile_status );
     glGetShaderiv( f_shader_id, GL_INFO_LOG_LENGTH, &info_log_len );
-    char f_shader_err_msg[ info_log_len ];
-    glGetShaderInfoLog( f_shader_id, info_log_len, NULL, f_shader_err_msg );
-    fprintf( stdout, "%s\n", f_shader_err_msg );
+    if( info_log_len > 1 ) {
+        char* f_shader_err_msg = ( char* )m_LoadStack.alloc( info_log_len, 1 );
+        if( f_shader_err_msg != NULL ) {
+            glGetShaderInfoLog( f_shader_id, info_log_len, NULL, f_shader_err_msg );
+            fprintf( stdout, "%s\n", f_shader_err_msg );
+        }
+    }
 
     // Link the program
     fprintf(stdout, "Linking program\n");
@@ -178,10 +161,13 @@ bool GLRenderer::loadShaders( const char* v_shader, const char* f_shader ) {
     // Check the program
     glGetProgramiv( program_id, GL_LINK_STATUS, &compile_status );
     glGetProgramiv( program_id, GL_INFO_LOG_LENGTH, &info_log_len );
-    int len = ( info_log_len > 1 ) ? info_log_len : 1;
-    char program_err_msg[ len ];
-    glGetProgramInfoLog(program_id, info_log_len, NULL, program_err_msg );
-    fprintf(stdout, "%s\n", program_err_msg );
+    if( info_log_len > 1 ) {
+        char* program_err_msg = ( char* )m_LoadStack.alloc( info_log_len, 1 );
+        if( program_err_msg != NULL ) {
+            glGetProgramInfoLog( program_id, info_log_len, NULL, program_err_msg );
+            fprintf( stdout, "%s\n", program_err_msg );
+        }
+    }
 
     // Store shader program id and the location id for MVP matrix
     m_ShaderProgramId = program_id;
@@ -189,8 +175,6 @@ bool GLRenderer::loadShaders( const char* v_shader, const char* f_shader ) {
 
     glDeleteShader( v_shader_id );
     glDeleteShader( f_shader_id );
-    delete[] f_buf_ptr;
-    delete[] v_buf_ptr;
 
     return true;
 }
@@ -205,10 +189,10 @@ void GLRenderer::draw( void ) {
     glUseProgram( m_ShaderProgramId );
 
     // Draw each object in our Renderable list
-    Node< GLRenderable* >* node_ptr = m_Renderables.begin();
-    while( node_ptr != NULL ) {
+    GLRenderable* renderable_ptr = m_Renderables.begin();
+    while( renderable_ptr != NULL ) {
 
-        const glm::mat4& model_matrix = node_ptr->item()->getModelMatrix();
+        const glm::mat4& model_matrix = renderable_ptr->getModelMatrix();
 
         glm::mat4 mvp = m_ProjectionMatrix * m_ViewMatrix * model_matrix;
 
@@ -216,7 +200,7 @@ void GLRenderer::draw( void ) {
         // in the "MVP" uniform
         glUniformMatrix4fv( m_ShaderMVPLocation, 1, GL_FALSE, &mvp[0][0] );
 
-        GLVertexDataStr& vertex_data = node_ptr->item()->getVertexDataRef();
+        GLVertexDataStr& vertex_data = renderable_ptr->getVertexDataRef();
         glBindBuffer( GL_ARRAY_BUFFER, vertex_data.buffer_id );
 
         // 1st attribute buffer for vertex positions
@@ -246,7 +230,7 @@ void GLRenderer::draw( void ) {
         glDisableVertexAttribArray( 0 );
         glDisableVertexAttribArray( 1 );
 
-        node_ptr = node_ptr->next();
+        renderable_ptr = m_Renderables.next( renderable_ptr );
     }
 }
 
@@ -268,4 +252,27 @@ void GLRenderer::loadVertexData( GLVertexDataStr& data ) {
         GL_STATIC_DRAW );
 }
 
+/*
+ * Reads a text file into m_LoadStack and null terminates it. The caller
+ * frees the buffer by rolling m_LoadStack back to its marker.
+ */
+char* GLRenderer::loadTextFile( const char* path ) {
+
+    FILE* fp = fopen( path, "r" );
+    if( fp == NULL ) {
+        return NULL;
+    }
+    // count size manually, as SEEK_END doesn't find the EOF properly
+    // for some reason when debugging code
+    unsigned int size = 0;
+    while( getc( fp ) != EOF ) { ++size; }
+    fseek( fp, 0, SEEK_SET );
 
+    char* buf_ptr = ( char* )m_LoadStack.alloc( size + 1, 1 );
+    if( buf_ptr != NULL ) {
+        size = fread( buf_ptr, 1, size, fp );
+        buf_ptr[ size ] = '\0';
+    }
+    fclose( fp );
+    return buf_ptr;
+}
@@ -21,8 +21,9 @@
 
 class GLRenderer {
 private:
-    // Linked list of Renderables to draw. (Rendering list)
-    List< GLRenderable* > m_Renderables;
+    // Linked list of Renderables to draw. (Rendering list) The links are
+    // inside the renderables, so adding one does not allocate.
+    IntrusiveList< GLRenderable > m_Renderables;
     // Running ID counter for new renderables.
     uint64_t m_RunningId;
     // ID of the compiled shader program.
@@ -34,16 +35,17 @@ private:
     // Projection and View -matrices. These stay constant during a frame.
     glm::mat4 m_ProjectionMatrix;
     glm::mat4 m_ViewMatrix;
+    // Scratch memory for temporaries of loading, e.g. shader sources
+    // and info logs. Freed to a marker at the end of each load.
+    StackAllocator m_LoadStack;
 
 public:
-    enum LIST_MEM_ALLOC_TYPE { ALLOC_TYPE_MEM_POOL = 0, ALLOC_TYPE_STANDARD };
+    // Size of the scratch stack used while loading
+    static const uint32_t kLoadStackBytes = 256 * 1024;
 
-    // Basic constructor, uses standard memory allocation with renderables list
-    GLRenderer() {}
-
-    // Constructor for specifying the memory allocation for renderables list
-    GLRenderer( LIST_MEM_ALLOC_TYPE alloc_type ) :
-        m_Renderables( alloc_type ) {}
+    // Basic constructor. The rendering list links the renderables
+    // themselves, so it needs no memory allocation of its own.
+    GLRenderer() : m_LoadStack( kLoadStackBytes ) {}
 
     ~GLRenderer() { cleanup(); }
     // Initializes vertex array object.
@@ -84,6 +86,10 @@ public:
 private:
     // Loads vertex data into GPU memory.
     void loadVertexData( GLVertexDataStr& data );
+
+    // Reads a text file into m_LoadStack, NULL if the file can not be read
+    // or does not fit.
+    char* loadTextFile( const char* path );
 };
 
 #endif /* #ifndef GL_RENDERER_H_ */
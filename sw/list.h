@@ -17,30 +17,127 @@
 #ifndef LIST_H_
 #define LIST_H_
 
-template <class T> class List; // Forward declaration to be used by Node below
+#include <cstddef>
+#include <iterator>
+#include <utility>
+
+/*
+ * Node allocation policies for List and UnrolledList. A policy has
+ *   void* alloc( size_t bytes )   returns NULL on failure
+ *   void dealloc( void* ptr )
+ *   uint32_t allocBatch( size_t bytes, uint32_t count, void** ptr_array )
+ *                                 returns the number of nodes allocated
+ *   void deallocBatch( void** ptr_array, uint32_t count )
+ * and is stored by value in the list, so the calls are resolved at
+ * compile time and a list can be bound to its own allocator instance.
+ */
+
+// Allocates nodes with the standard operator new
+struct ListAllocNew {
+    void* alloc( size_t bytes ) { return ::operator new( bytes, std::nothrow ); }
+    void dealloc( void* ptr ) { ::operator delete( ptr ); }
+    uint32_t allocBatch( size_t bytes, uint32_t count, void** ptr_array ) {
+        uint32_t done = 0;
+        while( done < count && ( ptr_array[ done ] = alloc( bytes ) ) != NULL ) done++;
+        return done;
+    }
+    void deallocBatch( void** ptr_array, uint32_t count ) {
+        for( uint32_t i = 0; i < count; i++ ) dealloc( ptr_array[ i ] );
+    }
+};
+
+// Allocates nodes through the global memory pool manager (POOL_ALLOC)
+struct ListAllocGlobalPool {
+    void* alloc( size_t bytes ) { return POOL_ALLOC( ( uint32_t )bytes ); }
+    void dealloc( void* ptr ) { POOL_DEALLOC( ptr ); }
+    uint32_t allocBatch( size_t bytes, uint32_t count, void** ptr_array ) {
+        return POOL_ALLOC_BATCH( ( uint32_t )bytes, count, ptr_array );
+    }
+    void deallocBatch( void** ptr_array, uint32_t count ) {
+        POOL_DEALLOC_BATCH( ptr_array, count );
+    }
+};
+
+// Allocates nodes from one MemoryPool, e.g. a private pool of the list
+// which keeps all of its nodes contiguous. Blocks must fit a node.
+class ListAllocPool {
+private:
+    MemoryPool* m_pPool;
+public:
+    explicit ListAllocPool( MemoryPool* pool_ptr ) : m_pPool( pool_ptr ) {}
+    void* alloc( size_t ) {
+        return m_pPool->isExhausted() ? NULL : m_pPool->alloc();
+    }
+    void dealloc( void* ptr ) { m_pPool->dealloc( ptr ); }
+    uint32_t allocBatch( size_t, uint32_t count, void** ptr_array ) {
+        return m_pPool->allocBatch( ptr_array, count );
+    }
+    void deallocBatch( void** ptr_array, uint32_t count ) {
+        m_pPool->deallocBatch( ptr_array, count );
+    }
+};
+
+// Allocates nodes from a FrameArena. Nodes are never freed one by one;
+// the list must be cleared or dropped before the arena is reset.
+class ListAllocArena {
+private:
+    FrameArena* m_pArena;
+public:
+    explicit ListAllocArena( FrameArena* arena_ptr ) : m_pArena( arena_ptr ) {}
+    void* alloc( size_t bytes ) { return m_pArena->alloc( ( uint32_t )bytes ); }
+    void dealloc( void* ) {}
+    uint32_t allocBatch( size_t bytes, uint32_t count, void** ptr_array ) {
+        uint32_t done = 0;
+        while( done < count && ( ptr_array[ done ] = alloc( bytes ) ) != NULL ) done++;
+        return done;
+    }
+    void deallocBatch( void**, uint32_t ) {}
+};
+
+// Allocates nodes through a MemPoolManager. With thread caching enabled
+// on the manager, nodes come from the calling thread's cache.
+class ListAllocManager {
+private:
+    MemPoolManager* m_pManager;
+public:
+    explicit ListAllocManager( MemPoolManager* manager_ptr ) : m_pManager( manager_ptr ) {}
+    void* alloc( size_t bytes ) { return m_pManager->alloc( ( uint32_t )bytes ); }
+    void dealloc( void* ptr ) { m_pManager->dealloc( ptr ); }
+    uint32_t allocBatch( size_t bytes, uint32_t count, void** ptr_array ) {
+        return m_pManager->allocBatch( ( uint32_t )bytes, count, ptr_array );
+    }
+    void deallocBatch( void** ptr_array, uint32_t count ) {
+        m_pManager->deallocBatch( ptr_array, count );
+    }
+};
+
+template <class T, class Alloc> class List; // Forward declaration to be used by Node below
 
 /**
  * Node implementation for a doubly linked list.
+ * The payload is constructed in place from the node's constructor arguments.
  */
 template <class T>
 class Node {
     // Let List access Node's private data
-    friend class List< T >;
+    template <class U, class Alloc> friend class List;
 private:
     Node* m_pNext; // Link to next node.
     Node* m_pPrev; // Link to previous node.
     T     m_Item;  // Payload
 
 public:
-    // Ensure links are init to NULL
-    Node() : m_pNext( NULL ), m_pPrev( NULL ) {}
+    // Ensure links are init to NULL, forwards the arguments to T's constructor
+    template <class... Args>
+    explicit Node( Args&&... args ) :
+        m_pNext( NULL ), m_pPrev( NULL ), m_Item( std::forward< Args >( args )... ) {}
 
     // Accessors to next and previous nodes
     Node* next() { return m_pNext; }
     Node* prev() { return m_pPrev; }
 
     // These both returns reference to node's payload object
-    T item() { return m_Item; }
+    T& item() { return m_Item; }
     T& operator*() { return m_Item; }
 };
 
@@ -48,108 +145,215 @@ public:
  * Simple doubly linked list. Items can be inserted either
  * through the head of the list or the end of the list.
  * Random access not possible.
+ * Nodes are allocated with the Alloc policy (see ListAllocNew).
+ * Items are constructed in place (emplaceBack/emplaceFront) or moved in,
+ * so move-only payloads can be stored. Walk with bidirectional iterators:
+ *   for( T& item : list ) ...
+ * or node by node starting from head().
+ * Bulk operations (insert of a range, removeIf, clear) allocate and free
+ * the nodes in batches of kBatchNodes through the allocation policy,
+ * and splice moves whole lists without touching the allocator.
  */
-template <class T>
+template <class T, class Alloc = ListAllocNew>
 class List {
 
+public:
+    /**
+     * Bidirectional iterator over the items. V is T or const T.
+     * end() is past the last item; decrementing it gives the last item.
+     */
+    template <class V>
+    class BasicIterator {
+    private:
+        Node< T >*  m_pNode; // Current node, NULL past the end.
+        const List* m_pList; // Owner list, to step back from end().
+
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef V                               value_type;
+        typedef std::ptrdiff_t                  difference_type;
+        typedef V*                              pointer;
+        typedef V&                              reference;
+
+        BasicIterator( Node< T >* node_ptr = NULL, const List* list_ptr = NULL ) :
+            m_pNode( node_ptr ), m_pList( list_ptr ) {}
+        // Iterator converts to ConstIterator
+        BasicIterator( const BasicIterator< T >& other ) :
+            m_pNode( other.node() ), m_pList( other.list() ) {}
+        BasicIterator& operator=( const BasicIterator& other ) = default;
+
+        // Node of the item, NULL past the end
+        Node< T >* node( void ) const { return m_pNode; }
+        const List* list( void ) const { return m_pList; }
+
+        V& operator*() const { return **m_pNode; }
+        V* operator->() const { return &**m_pNode; }
+
+        BasicIterator& operator++() { m_pNode = m_pNode->next(); return *this; }
+        BasicIterator operator++( int ) { BasicIterator old( *this ); ++*this; return old; }
+        BasicIterator& operator--() {
+            m_pNode = m_pNode != NULL ? m_pNode->prev() : m_pList->m_pTail;
+            return *this;
+        }
+        BasicIterator operator--( int ) { BasicIterator old( *this ); --*this; return old; }
+
+        bool operator==( const BasicIterator& other ) const { return m_pNode == other.m_pNode; }
+        bool operator!=( const BasicIterator& other ) const { return m_pNode != other.m_pNode; }
+    };
+
+    typedef BasicIterator< T >       Iterator;
+    typedef BasicIterator< const T > ConstIterator;
+
 private:
+    // Number of nodes per allocator batch request
+    static const uint32_t kBatchNodes = 64;
+
     Node< T >* m_pHead; // First node in the list.
     Node< T >* m_pTail; // Last node in the list.
-    // Whether to use memory pool or normal new -operator for node allocations.
-    const int m_AllocMethod;
-
-    // Utility for deallocating nodes
+    uint32_t m_Count;   // Number of items in the list.
+    // Allocator of the nodes
+    Alloc m_Alloc;
+
+    // Utilities for allocating and deallocating nodes. If T's constructor
+    // throws, newNode returns the memory before passing the exception on.
+    template <class... Args>
+    Node< T >* newNode( Args&&... args ) {
+        void* ptr = m_Alloc.alloc( sizeof( Node< T > ) );
+        if( ptr == NULL ) return NULL;
+        try {
+            return new( ptr ) Node< T >( std::forward< Args >( args )... );
+        }
+        catch( ... ) {
+            m_Alloc.dealloc( ptr );
+            throw;
+        }
+    }
     void deleteNode( Node< T >* node_ptr ) {
-        if( m_AllocMethod == USE_MEM_POOL_ALLOCATION ) {
-            POOL_DEALLOC( node_ptr );
-        }else{ delete node_ptr; }
+        node_ptr->~Node< T >();
+        m_Alloc.dealloc( node_ptr );
     }
 
-public:
-    enum AllocTypeEnum {
-        USE_MEM_POOL_ALLOCATION, USE_STANDARD_ALLOCATION };
+    // Link a new node to the front or to the end of the list
+    void linkFront( Node< T >* node_ptr );
+    void linkBack( Node< T >* node_ptr );
+    // Link a chain of 'count' nodes before pos_ptr (NULL: at the end)
+    void linkChain( Node< T >* pos_ptr, Node< T >* first_ptr, Node< T >* last_ptr,
+        uint32_t count );
+    // Unlink a node without deallocating it
+    void unlink( Node< T >* node_ptr );
+    // Destroy and deallocate a chain of nodes that ends in NULL
+    void deleteChain( Node< T >* first_ptr );
 
-    List() : m_pHead( NULL ), m_pTail( NULL ),
-        m_AllocMethod( USE_STANDARD_ALLOCATION ) {}
+    // Disable copy constructor
+    List( const List& copy );
 
-    List( int alloc_type ) :
-        m_pHead( NULL ), m_pTail( NULL ), m_AllocMethod( alloc_type ) {}
+public:
+    List() : m_pHead( NULL ), m_pTail( NULL ), m_Count( 0 ) {}
+
+    // Binds the list to the given allocator instance
+    explicit List( const Alloc& alloc ) :
+        m_pHead( NULL ), m_pTail( NULL ), m_Count( 0 ), m_Alloc( alloc ) {}
 
     // Destructor clears the list by deallocting all the nodes
     ~List() { clear(); }
 
-    // Inserts new object at the front of the list (allocates new node).
-    bool pushFront( T obj );
+    // Constructs a new item in place at the front of the list.
+    // Returns false if the node could not be allocated.
+    template <class... Args>
+    bool emplaceFront( Args&&... args ) {
+        Node< T >* node_ptr = newNode( std::forward< Args >( args )... );
+        if( node_ptr == NULL ) return false; // Alloc failed, return instantly.
+        linkFront( node_ptr );
+        return true;
+    }
 
-    // Inserts new object at the end of the list (allocates new node).
-    bool pushBack( T obj );
+    // Constructs a new item in place at the end of the list.
+    // Returns false if the node could not be allocated.
+    template <class... Args>
+    bool emplaceBack( Args&&... args ) {
+        Node< T >* node_ptr = newNode( std::forward< Args >( args )... );
+        if( node_ptr == NULL ) return false; // Alloc failed, return instantly.
+        linkBack( node_ptr );
+        return true;
+    }
 
-    // Removes and deallocates all nodes from the list
-    // (does not deallocate actual contents)
+    // Inserts a copy of the object or moves it to the front of the list.
+    bool pushFront( const T& obj ) { return emplaceFront( obj ); }
+    bool pushFront( T&& obj ) { return emplaceFront( std::move( obj ) ); }
+
+    // Inserts a copy of the object or moves it to the end of the list.
+    bool pushBack( const T& obj ) { return emplaceBack( obj ); }
+    bool pushBack( T&& obj ) { return emplaceBack( std::move( obj ) ); }
+
+    // Destroys all items and deallocates all nodes from the list
+    // (does not deallocate what pointer items point to)
     void clear( void );
 
     // Returns the number of elements in the list.
-    uint32_t size( void );
+    uint32_t size( void ) const { return m_Count; }
+    bool isEmpty( void ) const { return m_Count == 0; }
 
     // Returns pointer to the first node in the list.
-    Node< T >* begin( void ) { return m_pHead; };
+    Node< T >* head( void ) { return m_pHead; }
 
     // Returns pointer to the last node in the list.
-    Node< T >* end( void ) { return m_pTail; }
+    Node< T >* tail( void ) { return m_pTail; }
+
+    // Iterators to the first item and past the last item.
+    Iterator begin( void ) { return Iterator( m_pHead, this ); }
+    Iterator end( void ) { return Iterator( NULL, this ); }
+    ConstIterator begin( void ) const { return ConstIterator( m_pHead, this ); }
+    ConstIterator end( void ) const { return ConstIterator( NULL, this ); }
 
     // Removes the given node from the list and updates links.
     void remove( Node< T >* node_ptr );
-};
-
-/*
- * Inserts new object at the front of the list (allocates new node).
- */
-template <class T>
-bool List< T >::pushFront( T obj ) {
 
-    Node< T >* node_ptr = NULL;
-    if( m_AllocMethod == USE_MEM_POOL_ALLOCATION ) {
-        node_ptr = ( Node< T >* )POOL_ALLOC( sizeof( Node< T > ) );
-        node_ptr->m_pNext = NULL;
-        node_ptr->m_pPrev = NULL;
-    }
-    else {
-        node_ptr = new Node< T >();
+    // Removes the item and returns iterator to the item after it.
+    Iterator erase( Iterator it ) {
+        Node< T >* next_ptr = it.node()->m_pNext;
+        remove( it.node() );
+        return Iterator( next_ptr, this );
     }
 
-    if( node_ptr == NULL ) return false; // Alloc failed, return instantly.
+    // Inserts copies of the items [first, last) before pos. Returns the
+    // number of items inserted, less than the range only if the
+    // allocator ran out. Nothing is inserted if a copy throws.
+    template <class ForwardIt>
+    uint32_t insert( Iterator pos, ForwardIt first, ForwardIt last );
+
+    // Moves all items of 'other' before pos in O(1), leaving 'other'
+    // empty. The nodes are freed later by this list's allocator, so both
+    // lists must allocate from the same place (e.g. the same pool).
+    void splice( Iterator pos, List& other );
+
+    // Removes and deallocates every item for which pred( item ) is true
+    // in one pass. Returns the number of items removed.
+    template <class Pred>
+    uint32_t removeIf( Pred pred );
+};
 
+/*
+ * Links a new node to the front of the list.
+ */
+template <class T, class Alloc>
+void List< T, Alloc >::linkFront( Node< T >* node_ptr ) {
     if( m_pHead == NULL ) {
         m_pHead = node_ptr;
         m_pTail = node_ptr;
     }
     else {
-        node_ptr->m_Next = m_pHead;
+        node_ptr->m_pNext = m_pHead;
         m_pHead->m_pPrev = node_ptr;
         m_pHead = node_ptr;
     }
-    node_ptr->m_Item = obj;
-    return true;
+    ++m_Count;
 }
 
 /*
- * Inserts new object at the end of the list (allocates new node).
+ * Links a new node to the end of the list.
  */
-template <class T>
-bool List< T >::pushBack( T obj ) {
-
-    Node< T >* node_ptr = NULL;
-    if( m_AllocMethod == USE_MEM_POOL_ALLOCATION ) {
-        node_ptr = ( Node< T >* )POOL_ALLOC( sizeof( Node< T > ) );
-        node_ptr->m_pNext = NULL;
-        node_ptr->m_pPrev = NULL;
-    }
-    else {
-        node_ptr = new Node< T >();
-    }
-
-    if( node_ptr == NULL ) return false; // Alloc failed, return instantly.
-
+template <class T, class Alloc>
+void List< T, Alloc >::linkBack( Node< T >* node_ptr ) {
     if( m_pTail == NULL ) {
         m_pHead = node_ptr;
         m_pTail = node_ptr;
@@ -159,74 +363,556 @@ bool List< T >::pushBack( T obj ) {
         m_pTail->m_pNext = node_ptr;
         m_pTail = node_ptr;
     }
-    node_ptr->m_Item = obj;
-    return true;
+    ++m_Count;
 }
 
 /*
- * Removes and deallocates all nodes from the list but
- * does not deallocate actual contents.
+ * Links a chain of nodes, already linked to each other, before pos_ptr.
+ * A NULL pos_ptr links the chain to the end of the list.
  */
-template <class T>
-void List< T >::clear( void ) {
+template <class T, class Alloc>
+void List< T, Alloc >::linkChain( Node< T >* pos_ptr, Node< T >* first_ptr,
+    Node< T >* last_ptr, uint32_t count ) {
+    if( first_ptr == NULL ) return;
+
+    Node< T >* prev_ptr = pos_ptr != NULL ? pos_ptr->m_pPrev : m_pTail;
+    first_ptr->m_pPrev = prev_ptr;
+    last_ptr->m_pNext = pos_ptr;
+    if( prev_ptr != NULL ) prev_ptr->m_pNext = first_ptr;
+    else m_pHead = first_ptr;
+    if( pos_ptr != NULL ) pos_ptr->m_pPrev = last_ptr;
+    else m_pTail = last_ptr;
+    m_Count += count;
+}
+
+/*
+ * Unlinks the node from the list without deallocating it.
+ */
+template <class T, class Alloc>
+void List< T, Alloc >::unlink( Node< T >* node_ptr ) {
+    if( node_ptr->m_pPrev != NULL ) node_ptr->m_pPrev->m_pNext = node_ptr->m_pNext;
+    else m_pHead = node_ptr->m_pNext;
+    if( node_ptr->m_pNext != NULL ) node_ptr->m_pNext->m_pPrev = node_ptr->m_pPrev;
+    else m_pTail = node_ptr->m_pPrev;
+    --m_Count;
+}
+
+/*
+ * Destroys all items and deallocates all nodes from the list but
+ * does not deallocate what pointer items point to.
+ */
+template <class T, class Alloc>
+void List< T, Alloc >::clear( void ) {
     if( m_pHead == NULL ) return;
 
+    deleteChain( m_pHead );
+    m_pHead = NULL;
+    m_pTail = NULL;
+    m_Count = 0;
+
+    return;
+}
+
+/*
+ * Destroys the items of a chain and returns the nodes to the allocator
+ * in batches.
+ */
+template <class T, class Alloc>
+void List< T, Alloc >::deleteChain( Node< T >* first_ptr ) {
+    void* ptr_array[ kBatchNodes ];
+    uint32_t pending = 0;
+    Node< T >* node_ptr = first_ptr;
+
+    while( node_ptr != NULL ) {
+        Node< T >* next_node_ptr = node_ptr->m_pNext;
+        node_ptr->~Node< T >();
+        ptr_array[ pending++ ] = node_ptr;
+        if( pending == kBatchNodes ) {
+            m_Alloc.deallocBatch( ptr_array, pending );
+            pending = 0;
+        }
+        node_ptr = next_node_ptr;
+    }
+    if( pending > 0 ) m_Alloc.deallocBatch( ptr_array, pending );
+}
+
+/*
+ * Removes the given node from the list and updates remaining links.
+ */
+template <class T, class Alloc>
+void List< T, Alloc >::remove( Node< T >* node_ptr ) {
+    if( node_ptr == NULL ) return;
+
+    unlink( node_ptr );
+    deleteNode( node_ptr );
+    return;
+}
+
+/*
+ * Inserts copies of the items [first, last) before pos. The nodes are
+ * allocated kBatchNodes at a time, constructed and chained, and the
+ * chain is linked to the list in one step. If a copy throws, the list
+ * is left as it was.
+ */
+template <class T, class Alloc>
+template <class ForwardIt>
+uint32_t List< T, Alloc >::insert( Iterator pos, ForwardIt first, ForwardIt last ) {
+    void* ptr_array[ kBatchNodes ];
+    Node< T >* first_ptr = NULL;
+    Node< T >* last_ptr = NULL;
+    uint32_t remaining = ( uint32_t )std::distance( first, last );
+    uint32_t inserted = 0;
+
+    while( remaining > 0 ) {
+        uint32_t batch = remaining < kBatchNodes ? remaining : kBatchNodes;
+        uint32_t count = m_Alloc.allocBatch( sizeof( Node< T > ), batch, ptr_array );
+        uint32_t i = 0;
+        try {
+            for( ; i < count; i++, ++first ) {
+                Node< T >* node_ptr = new( ptr_array[ i ] ) Node< T >( *first );
+                node_ptr->m_pPrev = last_ptr;
+                if( last_ptr != NULL ) last_ptr->m_pNext = node_ptr;
+                else first_ptr = node_ptr;
+                last_ptr = node_ptr;
+            }
+        }
+        catch( ... ) {
+            // Leave the list unchanged: free the unused rest of the batch
+            // and the chain built so far
+            m_Alloc.deallocBatch( ptr_array + i, count - i );
+            deleteChain( first_ptr );
+            throw;
+        }
+        inserted += count;
+        remaining -= count;
+        if( count < batch ) break; // Alloc failed, insert what we have.
+    }
+    linkChain( pos.node(), first_ptr, last_ptr, inserted );
+    return inserted;
+}
+
+/*
+ * Moves all nodes of the other list before pos in O(1).
+ */
+template <class T, class Alloc>
+void List< T, Alloc >::splice( Iterator pos, List& other ) {
+    if( &other == this || other.m_pHead == NULL ) return;
+
+    linkChain( pos.node(), other.m_pHead, other.m_pTail, other.m_Count );
+    other.m_pHead = NULL;
+    other.m_pTail = NULL;
+    other.m_Count = 0;
+}
+
+/*
+ * Removes every item matching the predicate in one pass. The nodes
+ * are returned to the allocator in batches.
+ */
+template <class T, class Alloc>
+template <class Pred>
+uint32_t List< T, Alloc >::removeIf( Pred pred ) {
+    void* ptr_array[ kBatchNodes ];
+    uint32_t pending = 0;
+    uint32_t removed = 0;
     Node< T >* node_ptr = m_pHead;
 
-    /* Deallocate all nodes and clear the list. */
     while( node_ptr != NULL ) {
         Node< T >* next_node_ptr = node_ptr->m_pNext;
-        memset( node_ptr, 0, sizeof( Node< T > ) ); // zero all values within node
-        deleteNode( node_ptr );
+        if( pred( node_ptr->m_Item ) ) {
+            unlink( node_ptr );
+            node_ptr->~Node< T >();
+            ptr_array[ pending++ ] = node_ptr;
+            if( pending == kBatchNodes ) {
+                m_Alloc.deallocBatch( ptr_array, pending );
+                pending = 0;
+            }
+            removed++;
+        }
         node_ptr = next_node_ptr;
     }
+    if( pending > 0 ) m_Alloc.deallocBatch( ptr_array, pending );
+    return removed;
+}
+
+template <class T, int Tag> class IntrusiveList;
+
+/**
+ * Links of an element in an IntrusiveList. The element class derives
+ * from ListHook< T > (publicly), so the links live inside the element.
+ * An element can be in several lists at once by deriving from one hook
+ * per list, each with its own Tag.
+ */
+template <class T, int Tag = 0>
+class ListHook {
+    // Let IntrusiveList access the links
+    friend class IntrusiveList< T, Tag >;
+private:
+    T* m_pNext; // Link to next element.
+    T* m_pPrev; // Link to previous element.
+
+public:
+    // Ensure links are init to NULL
+    ListHook() : m_pNext( NULL ), m_pPrev( NULL ) {}
+    // A copy of an element is not in the original's list
+    ListHook( const ListHook& ) : m_pNext( NULL ), m_pPrev( NULL ) {}
+    ListHook& operator=( const ListHook& ) { return *this; }
+};
+
+/**
+ * Doubly linked list of elements that carry their own links (see
+ * ListHook). Inserting and removing never allocate, and walking the
+ * list only touches the elements themselves. The list does not own its
+ * elements: clear() and the destructor only unlink them.
+ * An element may be in one list per hook at a time.
+ */
+template <class T, int Tag = 0>
+class IntrusiveList {
+
+private:
+    T* m_pHead; // First element in the list.
+    T* m_pTail; // Last element in the list.
+    uint32_t m_Count; // Number of elements in the list.
+
+    // Returns the links of an element
+    static ListHook< T, Tag >* hook( T* obj_ptr ) {
+        return static_cast< ListHook< T, Tag >* >( obj_ptr );
+    }
+
+    // Disable copy constructor
+    IntrusiveList( const IntrusiveList& copy );
+
+public:
+    IntrusiveList() : m_pHead( NULL ), m_pTail( NULL ), m_Count( 0 ) {}
+
+    // Destructor unlinks all the elements
+    ~IntrusiveList() { clear(); }
+
+    // Links the element at the front of the list.
+    void pushFront( T* obj_ptr );
+
+    // Links the element at the end of the list.
+    void pushBack( T* obj_ptr );
+
+    // Unlinks all elements from the list (does not destroy them)
+    void clear( void );
+
+    // Returns the number of elements in the list.
+    uint32_t size( void ) { return m_Count; }
+
+    // Returns the first element in the list, NULL if the list is empty.
+    T* begin( void ) { return m_pHead; }
+
+    // Returns the last element in the list, NULL if the list is empty.
+    T* end( void ) { return m_pTail; }
+
+    // Returns the element after / before the given one, NULL at the end.
+    static T* next( T* obj_ptr ) { return hook( obj_ptr )->m_pNext; }
+    static T* prev( T* obj_ptr ) { return hook( obj_ptr )->m_pPrev; }
+
+    // Unlinks the given element from the list and updates links.
+    void remove( T* obj_ptr );
+};
+
+/*
+ * Links the element at the front of the list.
+ */
+template <class T, int Tag>
+void IntrusiveList< T, Tag >::pushFront( T* obj_ptr ) {
+    ListHook< T, Tag >* hook_ptr = hook( obj_ptr );
+    hook_ptr->m_pPrev = NULL;
+    hook_ptr->m_pNext = m_pHead;
+    if( m_pHead == NULL ) {
+        m_pTail = obj_ptr;
+    }
+    else {
+        hook( m_pHead )->m_pPrev = obj_ptr;
+    }
+    m_pHead = obj_ptr;
+    m_Count++;
+}
+
+/*
+ * Links the element at the end of the list.
+ */
+template <class T, int Tag>
+void IntrusiveList< T, Tag >::pushBack( T* obj_ptr ) {
+    ListHook< T, Tag >* hook_ptr = hook( obj_ptr );
+    hook_ptr->m_pNext = NULL;
+    hook_ptr->m_pPrev = m_pTail;
+    if( m_pTail == NULL ) {
+        m_pHead = obj_ptr;
+    }
+    else {
+        hook( m_pTail )->m_pNext = obj_ptr;
+    }
+    m_pTail = obj_ptr;
+    m_Count++;
+}
+
+/*
+ * Unlinks all elements, leaving their links cleared.
+ */
+template <class T, int Tag>
+void IntrusiveList< T, Tag >::clear( void ) {
+    T* obj_ptr = m_pHead;
+    while( obj_ptr != NULL ) {
+        ListHook< T, Tag >* hook_ptr = hook( obj_ptr );
+        obj_ptr = hook_ptr->m_pNext;
+        hook_ptr->m_pNext = NULL;
+        hook_ptr->m_pPrev = NULL;
+    }
     m_pHead = NULL;
     m_pTail = NULL;
+    m_Count = 0;
+}
 
-    return;
+/*
+ * Unlinks the given element from the list and updates remaining links.
+ */
+template <class T, int Tag>
+void IntrusiveList< T, Tag >::remove( T* obj_ptr ) {
+    if( obj_ptr == NULL ) return;
+
+    ListHook< T, Tag >* hook_ptr = hook( obj_ptr );
+    if( hook_ptr->m_pPrev != NULL ) {
+        hook( hook_ptr->m_pPrev )->m_pNext = hook_ptr->m_pNext;
+    }
+    else {
+        m_pHead = hook_ptr->m_pNext;
+    }
+    if( hook_ptr->m_pNext != NULL ) {
+        hook( hook_ptr->m_pNext )->m_pPrev = hook_ptr->m_pPrev;
+    }
+    else {
+        m_pTail = hook_ptr->m_pPrev;
+    }
+    hook_ptr->m_pNext = NULL;
+    hook_ptr->m_pPrev = NULL;
+    m_Count--;
 }
 
+/**
+ * Unrolled doubly linked list: every node (chunk) holds up to
+ * kChunkCapacity items in an array, so a walk takes one cache miss per
+ * chunk instead of one per item. Items are appended at the end in O(1)
+ * and erase() closes the gap within the chunk, keeping the items of a
+ * chunk contiguous and in order. Chunks are allocated like the nodes of
+ * List, through an allocation policy (see ListAllocNew).
+ *
+ * Walk with a Cursor:
+ *   for( UnrolledList< T >::Cursor c = list.begin(); c.isValid(); c = list.next( c ) )
+ */
+template <class T, uint32_t ChunkBytes = 256, class Alloc = ListAllocNew>
+class UnrolledList {
+
+private:
+    struct ChunkStr {
+        ChunkStr* pNext;
+        ChunkStr* pPrev;
+        uint32_t  count;
+    };
+
+    // The allocation policies only guarantee pointer alignment
+    static_assert( alignof( T ) <= alignof( void* ),
+        "UnrolledList does not support over-aligned types" );
+
+    // Items of a chunk follow its header, aligned for T
+    static const uint32_t kItemOffset =
+        ( sizeof( ChunkStr ) + alignof( T ) - 1 ) & ~( alignof( T ) - 1 );
+
+public:
+    // Items per chunk, so that the header, its padding and the items fit
+    // into ChunkBytes. At least one.
+    static const uint32_t kChunkCapacity =
+        ChunkBytes >= kItemOffset + sizeof( T ) ?
+        ( ChunkBytes - kItemOffset ) / sizeof( T ) : 1;
+
+    // Position of one item, invalid past the last item
+    class Cursor {
+        friend class UnrolledList;
+    private:
+        ChunkStr* m_pChunk;
+        uint32_t  m_Index;
+    public:
+        Cursor( ChunkStr* chunk_ptr = NULL, uint32_t index = 0 ) :
+            m_pChunk( chunk_ptr ), m_Index( index ) {}
+        bool isValid( void ) { return m_pChunk != NULL; }
+        T& operator*() { return UnrolledList::getItems( m_pChunk )[ m_Index ]; }
+        T* operator->() { return &UnrolledList::getItems( m_pChunk )[ m_Index ]; }
+    };
+
+private:
+    ChunkStr* m_pHead;  // First chunk in the list.
+    ChunkStr* m_pTail;  // Last chunk in the list.
+    uint32_t  m_Count;  // Number of items in the list.
+    // Allocator of the chunks
+    Alloc     m_Alloc;
+
+    static T* getItems( ChunkStr* chunk_ptr ) {
+        return ( T* )( ( uint8_t* )chunk_ptr + kItemOffset );
+    }
+    static uint32_t getChunkSize( void ) {
+        return kItemOffset + kChunkCapacity * sizeof( T );
+    }
+
+    // Utilities for allocating, linking and deallocating chunks
+    ChunkStr* addChunk( void );
+    void deleteChunk( ChunkStr* chunk_ptr );
+
+    // Disable copy constructor
+    UnrolledList( const UnrolledList& copy );
+
+public:
+    UnrolledList() : m_pHead( NULL ), m_pTail( NULL ), m_Count( 0 ) {}
+
+    // Binds the list to the given allocator instance
+    explicit UnrolledList( const Alloc& alloc ) : m_pHead( NULL ), m_pTail( NULL ),
+        m_Count( 0 ), m_Alloc( alloc ) {}
+
+    // Destructor destroys the items and deallocates all the chunks
+    ~UnrolledList() { clear(); }
+
+    // Appends a copy of the object at the end of the list.
+    // Returns false if a new chunk could not be allocated.
+    bool pushBack( const T& obj );
+
+    // Destroys all items and deallocates the chunks
+    void clear( void );
+
+    // Returns the number of items in the list.
+    uint32_t size( void ) { return m_Count; }
+
+    // Cursor to the first item, invalid if the list is empty.
+    Cursor begin( void ) { return Cursor( m_pHead, 0 ); }
+
+    // Cursor to the item after the given one, invalid at the end.
+    Cursor next( Cursor cursor ) {
+        if( ++cursor.m_Index < cursor.m_pChunk->count ) {
+            return cursor;
+        }
+        return Cursor( cursor.m_pChunk->pNext, 0 );
+    }
+
+    // Erases the item at the cursor by move-assigning the rest of its
+    // chunk down.
+    // A chunk left empty is deallocated. Returns a cursor to the item
+    // that followed the erased one.
+    Cursor erase( Cursor cursor );
+
+    // Number of chunks in the list, for measuring the fill rate
+    uint32_t getChunkCount( void );
+};
+
 /*
- * Returns the number of elements in the list.
+ * Allocates a chunk and links it at the end of the list.
  */
-template <class T>
-uint32_t List< T >::size( void ) {
-    uint32_t count = 0;
-    Node< int >* node_ptr = m_pHead;
-    while( node_ptr != NULL ) {
-        ++count;
-        node_ptr = node_ptr->m_pNext;
+template <class T, uint32_t ChunkBytes, class Alloc>
+typename UnrolledList< T, ChunkBytes, Alloc >::ChunkStr*
+UnrolledList< T, ChunkBytes, Alloc >::addChunk( void ) {
+    ChunkStr* chunk_ptr = ( ChunkStr* )m_Alloc.alloc( getChunkSize() );
+    if( chunk_ptr == NULL ) return NULL;
+
+    chunk_ptr->pNext = NULL;
+    chunk_ptr->pPrev = m_pTail;
+    chunk_ptr->count = 0;
+    if( m_pTail == NULL ) {
+        m_pHead = chunk_ptr;
     }
-    return count;
+    else {
+        m_pTail->pNext = chunk_ptr;
+    }
+    m_pTail = chunk_ptr;
+    return chunk_ptr;
 }
 
 /*
- * Removes the given node from the list and updates remaining links.
+ * Unlinks and deallocates an empty chunk.
  */
-template <class T>
-void List< T >::remove( Node< T >* node_ptr ) {
-    if( node_ptr == NULL ) return;
+template <class T, uint32_t ChunkBytes, class Alloc>
+void UnrolledList< T, ChunkBytes, Alloc >::deleteChunk( ChunkStr* chunk_ptr ) {
+    if( chunk_ptr->pPrev != NULL ) {
+        chunk_ptr->pPrev->pNext = chunk_ptr->pNext;
+    }
+    else {
+        m_pHead = chunk_ptr->pNext;
+    }
+    if( chunk_ptr->pNext != NULL ) {
+        chunk_ptr->pNext->pPrev = chunk_ptr->pPrev;
+    }
+    else {
+        m_pTail = chunk_ptr->pPrev;
+    }
+    m_Alloc.dealloc( chunk_ptr );
+}
 
-    if( node_ptr->m_pPrev != NULL ) {
-        node_ptr->m_pPrev->m_pNext = node_ptr->m_pNext;
+/*
+ * Appends a copy of the object, adding a chunk when the last one is full.
+ */
+template <class T, uint32_t ChunkBytes, class Alloc>
+bool UnrolledList< T, ChunkBytes, Alloc >::pushBack( const T& obj ) {
+    ChunkStr* chunk_ptr = m_pTail;
+    if( chunk_ptr == NULL || chunk_ptr->count == kChunkCapacity ) {
+        chunk_ptr = addChunk();
+        if( chunk_ptr == NULL ) return false; // Alloc failed, return instantly.
     }
-    if( node_ptr->m_pNext != NULL ) {
-        node_ptr->m_pNext->m_pPrev = node_ptr->m_pPrev;
+    new( &getItems( chunk_ptr )[ chunk_ptr->count ] ) T( obj );
+    chunk_ptr->count++;
+    m_Count++;
+    return true;
+}
+
+/*
+ * Destroys all items and deallocates the chunks.
+ */
+template <class T, uint32_t ChunkBytes, class Alloc>
+void UnrolledList< T, ChunkBytes, Alloc >::clear( void ) {
+    while( m_pHead != NULL ) {
+        T* item_array = getItems( m_pHead );
+        for( uint32_t i = 0; i < m_pHead->count; i++ ) {
+            item_array[ i ].~T();
+        }
+        m_pHead->count = 0;
+        deleteChunk( m_pHead );
     }
-    if( node_ptr == m_pHead && node_ptr == m_pTail ) {
-        m_pHead = NULL;
-        m_pTail = NULL;
+    m_Count = 0;
+}
+
+/*
+ * Erases an item and closes the gap within its chunk.
+ */
+template <class T, uint32_t ChunkBytes, class Alloc>
+typename UnrolledList< T, ChunkBytes, Alloc >::Cursor
+UnrolledList< T, ChunkBytes, Alloc >::erase( Cursor cursor ) {
+    ChunkStr* chunk_ptr = cursor.m_pChunk;
+    T* item_array = getItems( chunk_ptr );
+    for( uint32_t i = cursor.m_Index; i + 1 < chunk_ptr->count; i++ ) {
+        item_array[ i ] = std::move( item_array[ i + 1 ] );
     }
-    else if( node_ptr == m_pHead ) {
-        m_pHead = node_ptr->m_pNext;
+    item_array[ chunk_ptr->count - 1 ].~T();
+    chunk_ptr->count--;
+    m_Count--;
+
+    if( chunk_ptr->count == 0 ) {
+        ChunkStr* next_ptr = chunk_ptr->pNext;
+        deleteChunk( chunk_ptr );
+        return Cursor( next_ptr, 0 );
     }
-    else if( node_ptr == m_pTail ) {
-        m_pTail = node_ptr->m_pPrev;
+    if( cursor.m_Index < chunk_ptr->count ) {
+        return cursor;
     }
-    memset( node_ptr, 0, sizeof( Node< T > ) );
-    deleteNode( node_ptr );
-    return;
+    return Cursor( chunk_ptr->pNext, 0 );
 }
 
+/*
+ * Returns the number of chunks in the list.
+ */
+template <class T, uint32_t ChunkBytes, class Alloc>
+uint32_t UnrolledList< T, ChunkBytes, Alloc >::getChunkCount( void ) {
+    uint32_t count = 0;
+    for( ChunkStr* chunk_ptr = m_pHead; chunk_ptr != NULL; chunk_ptr = chunk_ptr->pNext ) {
+        ++count;
+    }
+    return count;
+}
 
 #endif /* #ifndef LIST_H_ */
@@ -21,8 +21,22 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
+#include <cstddef>
 //#define NDEBUG
 #include <assert.h>
+#include <new>
+#include <mutex>
+#include <atomic>
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#define MEM_POOL_HAS_MMAP
+#endif
 
 #include "mem_pool.h"
 
@@ -38,59 +52,1080 @@
 /* class MemoryPool see mem_pool.h */
 /*----------------------------------------------------------------------------*/
 
-MemoryPool::MemoryPool( uint32_t block_size, uint32_t block_count )
-    : m_BlockSize( block_size ),
-      m_BlockCount( block_count ) {
+/*
+ * Aligned allocation for the chunks of LAYOUT_ALIGNED pools.
+ */
+static void* allocAligned( size_t alignment, size_t size ) {
+#ifdef _WIN32
+    return _aligned_malloc( size, alignment );
+#else
+    void* ptr = NULL;
+    if( posix_memalign( &ptr, alignment, size ) != 0 ) {
+        return NULL;
+    }
+    return ptr;
+#endif
+}
+
+static void freeAligned( void* ptr ) {
+#ifdef _WIN32
+    _aligned_free( ptr );
+#else
+    free( ptr );
+#endif
+}
+
+MemoryPool::MemoryPool( uint32_t block_size, uint32_t block_count,
+    const MemPoolConfigStr& config )
+    : m_pPool( NULL ),
+      m_pChunks( NULL ),
+      m_pChunkTable( NULL ),
+      m_ChunkTableLen( 0 ),
+      m_pFreeMemBlock( NULL ),
+      m_pBumpPtr( NULL ),
+      m_pBumpEnd( NULL ),
+      m_BlockStride( SIZE_MEM_BLOCK_HEADER + block_size ),
+      m_HeaderSize( SIZE_MEM_BLOCK_HEADER ),
+      m_BlockSize( block_size ),
+      m_BlockCount( block_count ),
+      m_UncommittedBlocks( block_count ),
+      m_ChunkAllocFailed( false ),
+      m_ChunkCount( 0 ),
+      m_UsedBlocks( 0 ),
+      m_PeakUsedBlocks( 0 ),
+      m_FailedAllocs( 0 ),
+      m_TrimLevel( 0 ),
+      m_TrimArmed( false ),
+      m_Config( config ),
+      m_PoolId( 0 ),
+      m_Owner(),
+      m_RemoteFree( NULL ) {
 
     assert( block_size >= sizeof( void* ) &&
         "Error: Block size must be big enough to hold one pointer when the block is not used\n" );
 
-    m_pPool = malloc( ( SIZE_MEM_BLOCK_HEADER + block_size ) * block_count );
-//    DPRINT( "allocated pool size: %lu\n", ( SIZE_MEM_BLOCK_HEADER + block_size ) * block_count )
-    assert( m_pPool && "ERROR: could not allocate memory for the pool" );
-
-    // Init Pointer to first free mem block
-    m_pFreeMemBlock = ( MemBlockStr* )m_pPool;
-    MemBlockStr* pBlock = m_pFreeMemBlock;
-//    printf( "pBlock: %p\n", pBlock );
-    for( uint32_t i = 0; i < block_count; i++ ) {
-        pBlock->header = 0;
-        pBlock->pData = NULL;
-        //  Set data field to point to next free block
-        if( i < block_count - 1 ) {
-            pBlock->pData = ( void* )( ( uint8_t* )pBlock + SIZE_MEM_BLOCK_HEADER + block_size );
-            }
-        pBlock = ( MemBlockStr* )pBlock->pData;
-//        DPRINT( "pBlock: %p\n", pBlock )
+    if( m_Config.layout == MemPoolConfigStr::LAYOUT_ALIGNED ) {
+        uint32_t alignment = m_Config.alignment;
+        assert( alignment >= sizeof( void* ) &&
+            ( alignment & ( alignment - 1 ) ) == 0 &&
+            "Error: Block alignment must be a power of two and at least the size of a pointer\n" );
+        m_HeaderSize = 0;
+        m_BlockStride = ( block_size + alignment - 1 ) & ~( alignment - 1 );
+        assert( ( ( sizeof( MemChunkStr ) + alignment - 1 ) & ~( alignment - 1 ) ) +
+            m_BlockStride <= kAlignedChunkBytes &&
+            "Error: Block does not fit into an aligned chunk\n" );
+    }
+    if( m_Config.growth_blocks == 0 ) {
+        m_Config.growth_blocks = block_count;
+    }
+    addChunk();
+    assert( m_pChunks && "ERROR: could not allocate memory for the pool" );
+    if( m_pChunks != NULL ) {
+        m_pPool = m_pBumpPtr;
     }
+    updateTrimLevel();
 }
 
 MemoryPool::~MemoryPool( void )
     {
-    if( m_pPool )
+    MemChunkStr* pChunk = m_pChunks;
+    while( pChunk != NULL )
         {
-        free( m_pPool );
+        MemChunkStr* pNext = pChunk->pNext;
+        freeChunkMemory( pChunk );
+        pChunk = pNext;
+        }
+    free( m_pChunkTable );
+    }
+
+#ifdef MEM_POOL_HAS_MMAP
+/*
+ * Maps given number of bytes aligned to 'alignment'. Reserves
+ * alignment - page size extra bytes and unmaps the unaligned head and the
+ * tail of the reservation. Returns NULL on failure.
+ */
+static void* mapAligned( size_t bytes, size_t alignment, int extra_flags ) {
+    size_t page = ( size_t )sysconf( _SC_PAGESIZE );
+    size_t extra = alignment > page ? alignment - page : 0;
+    uint8_t* ptr = ( uint8_t* )mmap( NULL, bytes + extra, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | extra_flags, -1, 0 );
+    if( ptr == MAP_FAILED ) {
+        return NULL;
+    }
+    if( extra > 0 ) {
+        uint8_t* aligned_ptr = ( uint8_t* )( ( ( uintptr_t )ptr + alignment - 1 ) &
+            ~( uintptr_t )( alignment - 1 ) );
+        if( aligned_ptr > ptr ) {
+            munmap( ptr, aligned_ptr - ptr );
+        }
+        size_t tail = ( ptr + bytes + extra ) - ( aligned_ptr + bytes );
+        if( tail > 0 ) {
+            munmap( aligned_ptr + bytes, tail );
+        }
+        ptr = aligned_ptr;
+    }
+    return ptr;
+}
+#endif /* #ifdef MEM_POOL_HAS_MMAP */
+
+/**
+ * Allocates chunk memory from the configured backing store and
+ * prefaults it if requested. map_bytes of the returned chunk tells
+ * freeChunkMemory how it was obtained.
+ */
+MemChunkStr* MemoryPool::allocChunkMemory( size_t bytes, size_t alignment )
+    {
+    MemChunkStr* pChunk = NULL;
+    size_t map_bytes = 0;
+
+#ifdef MEM_POOL_HAS_MMAP
+    if( m_Config.backing != MemPoolConfigStr::BACKING_MALLOC ) {
+        size_t page = ( size_t )sysconf( _SC_PAGESIZE );
+        map_bytes = ( bytes + page - 1 ) & ~( page - 1 );
+#ifdef MAP_HUGETLB
+        // Explicit huge pages are naturally aligned to kHugePageBytes
+        if( m_Config.backing == MemPoolConfigStr::BACKING_HUGE_PAGES &&
+            bytes >= kHugePageBytes && alignment <= kHugePageBytes ) {
+            size_t huge_bytes = ( bytes + kHugePageBytes - 1 ) &
+                ~( size_t )( kHugePageBytes - 1 );
+            pChunk = ( MemChunkStr* )mapAligned( huge_bytes, 0, MAP_HUGETLB );
+            if( pChunk != NULL ) {
+                map_bytes = huge_bytes;
+                }
+            }
+#endif
+        if( pChunk == NULL ) {
+            pChunk = ( MemChunkStr* )mapAligned( map_bytes, alignment, 0 );
+#ifdef MADV_HUGEPAGE
+            if( pChunk != NULL &&
+                m_Config.backing == MemPoolConfigStr::BACKING_HUGE_PAGES ) {
+                // Fall back to transparent huge pages
+                madvise( pChunk, map_bytes, MADV_HUGEPAGE );
+                }
+#endif
+            }
+        if( pChunk == NULL ) {
+            return NULL;
+            }
+        }
+    else
+#endif /* #ifdef MEM_POOL_HAS_MMAP */
+    if( alignment > 0 ) {
+        pChunk = ( MemChunkStr* )allocAligned( alignment, bytes );
+        }
+    else {
+        pChunk = ( MemChunkStr* )malloc( bytes );
+        }
+    if( pChunk == NULL ) {
+        return NULL;
+        }
+
+    if( m_Config.prefault ) {
+        // Write one byte per page to fault the whole chunk in now
+        volatile uint8_t* pByte = ( volatile uint8_t* )pChunk;
+        for( size_t offset = 0; offset < bytes; offset += 4096 ) {
+            pByte[ offset ] = 0;
+            }
+        }
+    pChunk->map_bytes = map_bytes;
+    return pChunk;
+    }
+
+/**
+ * Returns chunk memory to where allocChunkMemory got it from.
+ */
+void MemoryPool::freeChunkMemory( MemChunkStr* pChunk )
+    {
+#ifdef MEM_POOL_HAS_MMAP
+    if( pChunk->map_bytes > 0 ) {
+        munmap( pChunk, pChunk->map_bytes );
+        return;
+        }
+#endif
+    if( m_Config.layout == MemPoolConfigStr::LAYOUT_ALIGNED ) {
+        freeAligned( pChunk );
+        }
+    else {
+        free( pChunk );
+        }
+    }
+
+/**
+ * Allocates a chunk for the uncommitted blocks. Header layout pools get
+ * one chunk for all of them; aligned pools get one kAlignedChunkBytes
+ * chunk and leave the rest for later. The blocks are not initialized;
+ * the chunk becomes the never used region from which alloc() carves
+ * blocks. Returns NULL if the allocation fails.
+ */
+MemChunkStr* MemoryPool::addChunk( void )
+    {
+    MemChunkStr* pChunk = NULL;
+    uint8_t* pFirst = NULL;
+    uint32_t block_count = m_UncommittedBlocks;
+
+    uint32_t offset = getChunkOffset();
+
+    if( m_Config.layout == MemPoolConfigStr::LAYOUT_ALIGNED ) {
+        uint32_t max_count = ( kAlignedChunkBytes - offset ) / m_BlockStride;
+        if( block_count > max_count ) {
+            block_count = max_count;
+            }
+        pChunk = allocChunkMemory( kAlignedChunkBytes, kAlignedChunkBytes );
+        }
+    else {
+        pChunk = allocChunkMemory(
+            offset + ( size_t )m_BlockStride * block_count, 0 );
+        }
+    pFirst = ( uint8_t* )pChunk + offset;
+//    DPRINT( "allocated chunk of %u blocks\n", block_count )
+    if( pChunk == NULL ) {
+        return NULL;
+        }
+    if( m_ChunkCount == m_ChunkTableLen ) {
+        uint32_t table_len = m_ChunkTableLen > 0 ? 2 * m_ChunkTableLen : 4;
+        MemChunkStr** pTable = ( MemChunkStr** )realloc( m_pChunkTable,
+            table_len * sizeof( MemChunkStr* ) );
+        if( pTable == NULL ) {
+            freeChunkMemory( pChunk );
+            return NULL;
+            }
+        m_pChunkTable = pTable;
+        m_ChunkTableLen = table_len;
+        }
+    // Keep the table sorted by address
+    uint32_t index = m_ChunkCount;
+    while( index > 0 && m_pChunkTable[ index - 1 ] > pChunk ) {
+        m_pChunkTable[ index ] = m_pChunkTable[ index - 1 ];
+        index--;
+        }
+    m_pChunkTable[ index ] = pChunk;
+    pChunk->pPool = this;
+    pChunk->block_count = block_count;
+    pChunk->pNext = m_pChunks;
+    m_pChunks = pChunk;
+    m_UncommittedBlocks -= block_count;
+    m_ChunkCount++;
+
+    m_pBumpPtr = pFirst;
+    m_pBumpEnd = pFirst + ( size_t )m_BlockStride * block_count;
+    return pChunk;
+    }
+
+/**
+ * Aligned pools start the blocks at the first multiple of the alignment.
+ * Header pools place the first block so that its payload is 16 byte
+ * aligned.
+ */
+uint32_t MemoryPool::getChunkOffset( void )
+    {
+    if( m_Config.layout == MemPoolConfigStr::LAYOUT_ALIGNED ) {
+        uint32_t alignment = m_Config.alignment;
+        return ( sizeof( MemChunkStr ) + alignment - 1 ) & ~( alignment - 1 );
+        }
+    return ( ( sizeof( MemChunkStr ) + m_HeaderSize + 15 ) & ~15 ) - m_HeaderSize;
+    }
+
+/**
+ * Calculates how many blocks the pool grows by from the growth policy,
+ * clamped so that the pool stays within max_block_count.
+ */
+uint32_t MemoryPool::getGrowthBlockCount( void )
+    {
+    uint32_t count = 0;
+    switch( m_Config.growth ) {
+        case MemPoolConfigStr::GROWTH_FIXED:
+            count = m_Config.growth_blocks;
+            break;
+        case MemPoolConfigStr::GROWTH_GEOMETRIC:
+            count = m_BlockCount > 0 ? m_BlockCount : 1;
+            break;
+        default:
+            return 0;
+        }
+    if( m_Config.max_block_count > 0 ) {
+        if( m_BlockCount >= m_Config.max_block_count ) {
+            return 0;
+            }
+        if( count > m_Config.max_block_count - m_BlockCount ) {
+            count = m_Config.max_block_count - m_BlockCount;
+            }
+        }
+    return count;
+    }
+
+/**
+ * Commits the uncommitted blocks, or grows the pool first if there are
+ * none, so that the never used region has blocks to carve. The capacity
+ * only grows once the chunk for the new blocks has been allocated.
+ */
+bool MemoryPool::refillBumpRegion( void )
+    {
+    if( m_UncommittedBlocks == 0 ) {
+        uint32_t count = getGrowthBlockCount();
+        if( count == 0 ) {
+            return false;
+            }
+        m_UncommittedBlocks = count;
+        if( addChunk() == NULL ) {
+            m_UncommittedBlocks = 0;
+            m_ChunkAllocFailed = true;
+            return false;
+            }
+        m_BlockCount += count;
+        updateTrimLevel();
+        }
+    else if( addChunk() == NULL ) {
+        m_ChunkAllocFailed = true;
+        return false;
         }
+    m_ChunkAllocFailed = false;
+    return m_pBumpPtr != m_pBumpEnd;
     }
 
 /**
  * Allocates a fixed size block from the pool and returns
  * the address to the data section of the block.
- * If no free blocks left, returns NULL.
+ * If no free blocks left and the pool can not grow, returns NULL.
  */
 void* MemoryPool::alloc( void )
     {
-    MemBlockStr* pBlock = m_pFreeMemBlock;
+    uint8_t* pBlock = m_pFreeMemBlock;
+
+    if( pBlock == NULL &&
+        m_RemoteFree.load( std::memory_order_relaxed ) != NULL ) {
+        // Reuse the blocks other threads have freed before carving
+        drainRemoteFrees();
+        pBlock = m_pFreeMemBlock;
+        }
+
+    if( pBlock != NULL ) {
+        // Update pFreeMemBlock to point to next free memory block,
+        // which is stored in the block's data segment
+        m_pFreeMemBlock = ( uint8_t* )*getLink( pBlock );
+        }
+    else {
+        // Free list is empty, carve a never used block
+        if( m_pBumpPtr != m_pBumpEnd || refillBumpRegion() ) {
+            pBlock = m_pBumpPtr;
+            m_pBumpPtr += m_BlockStride;
+            }
+        }
 
     assert( pBlock != NULL && "Error: Out of memory. Memory pool is full.\n" );
 
     if( pBlock == NULL ) {
+        m_FailedAllocs++;
         return NULL;
         }
+    if( ++m_UsedBlocks > m_TrimLevel ) {
+        m_TrimArmed = true;
+        }
+    if( m_UsedBlocks > m_PeakUsedBlocks ) {
+        m_PeakUsedBlocks = m_UsedBlocks;
+        }
+
+    if( m_HeaderSize > 0 ) {
+        // put pool id as header data and set the MSB to indicate that
+        // this blocks is reserved.
+        MemBlockStr* pHeader = ( MemBlockStr* )pBlock;
+        pHeader->header = ( uint32_t )m_PoolId;
+        pHeader->header |= ( 1 << 31 );
+        }
+    return pBlock + m_HeaderSize;
+    }
+
+/**
+ * Frees one block in the pool and adds it to the head of the free block list.
+ */
+void MemoryPool::deallocLocal( void* ptr )
+    {
+    uint8_t* pBlock = ( uint8_t* )ptr - m_HeaderSize;
+    *getLink( pBlock ) = m_pFreeMemBlock;
+    if( m_HeaderSize > 0 ) {
+        ( ( MemBlockStr* )pBlock )->header &= ~( 1 << 31 );
+        }
+    m_pFreeMemBlock = pBlock;
+    if( --m_UsedBlocks < m_TrimLevel && m_TrimArmed ) {
+        trim();
+        }
+    }
+
+/**
+ * Pushes the block onto the remote free queue. The queue is a stack that
+ * only the owner empties, and always as a whole, so a plain compare and
+ * swap on the head is free of the ABA problem.
+ */
+void MemoryPool::deallocRemote( void* ptr )
+    {
+    uint8_t* pBlock = ( uint8_t* )ptr - m_HeaderSize;
+    if( m_HeaderSize > 0 ) {
+        ( ( MemBlockStr* )pBlock )->header &= ~( 1 << 31 );
+        }
+    uint8_t* pHead = m_RemoteFree.load( std::memory_order_relaxed );
+    do {
+        *getLink( pBlock ) = pHead;
+        } while( !m_RemoteFree.compare_exchange_weak( pHead, pBlock,
+                     std::memory_order_release, std::memory_order_relaxed ) );
+    }
+
+/**
+ * Detaches the whole remote free queue and splices it onto the free list.
+ */
+uint32_t MemoryPool::drainRemoteFrees( void )
+    {
+    uint8_t* pFirst = m_RemoteFree.exchange( NULL, std::memory_order_acquire );
+    if( pFirst == NULL ) {
+        return 0;
+        }
+    uint32_t count = 1;
+    uint8_t* pLast = pFirst;
+    while( *getLink( pLast ) != NULL ) {
+        pLast = ( uint8_t* )*getLink( pLast );
+        count++;
+        }
+    *getLink( pLast ) = m_pFreeMemBlock;
+    m_pFreeMemBlock = pFirst;
+    m_UsedBlocks -= count;
+    return count;
+    }
+
+/**
+ * Allocates up to 'count' blocks. The first blocks are detached from the
+ * head of the free list as one segment, the rest are carved from the never
+ * used region a chunk at a time. Block headers are written in the same pass.
+ */
+uint32_t MemoryPool::allocBatch( void** ptr_array, uint32_t count )
+    {
+    uint32_t done = 0;
+    if( m_RemoteFree.load( std::memory_order_relaxed ) != NULL ) {
+        drainRemoteFrees();
+        }
+    uint8_t* pBlock = m_pFreeMemBlock;
+    while( done < count && pBlock != NULL ) {
+        ptr_array[ done++ ] = pBlock;
+        pBlock = ( uint8_t* )*getLink( pBlock );
+        }
+    m_pFreeMemBlock = pBlock;
 
-    // Update pFreeMemBlock to point to next free memory block,
-    // which is stored in the block's data segment
-    m_pFreeMemBlock = ( MemBlockStr* )( pBlock->pData );
+    while( done < count &&
+           ( m_pBumpPtr != m_pBumpEnd || refillBumpRegion() ) ) {
+        uint32_t available = ( uint32_t )( ( m_pBumpEnd - m_pBumpPtr ) / m_BlockStride );
+        uint32_t n = count - done < available ? count - done : available;
+        for( uint32_t i = 0; i < n; i++ ) {
+            ptr_array[ done++ ] = m_pBumpPtr;
+            m_pBumpPtr += m_BlockStride;
+            }
+        }
+
+    if( m_HeaderSize > 0 ) {
+        uint32_t header = ( uint32_t )m_PoolId | ( 1 << 31 );
+        for( uint32_t i = 0; i < done; i++ ) {
+            ( ( MemBlockStr* )ptr_array[ i ] )->header = header;
+            ptr_array[ i ] = ( uint8_t* )ptr_array[ i ] + m_HeaderSize;
+            }
+        }
+    m_UsedBlocks += done;
+    m_FailedAllocs += count - done;
+    if( m_UsedBlocks > m_TrimLevel ) {
+        m_TrimArmed = true;
+        }
+    if( m_UsedBlocks > m_PeakUsedBlocks ) {
+        m_PeakUsedBlocks = m_UsedBlocks;
+        }
+    return done;
+    }
+
+/**
+ * Frees 'count' blocks of this pool. The blocks are chained in array order
+ * and the chain is spliced onto the head of the free list, so the first
+ * block of the array is the next one alloc() returns.
+ */
+void MemoryPool::deallocBatch( void** ptr_array, uint32_t count )
+    {
+    uint8_t* pNext = m_pFreeMemBlock;
+    for( uint32_t i = count; i > 0; i-- ) {
+        uint8_t* pBlock = ( uint8_t* )ptr_array[ i - 1 ] - m_HeaderSize;
+        *getLink( pBlock ) = pNext;
+        if( m_HeaderSize > 0 ) {
+            ( ( MemBlockStr* )pBlock )->header &= ~( 1 << 31 );
+            }
+        pNext = pBlock;
+        }
+    m_pFreeMemBlock = pNext;
+    m_UsedBlocks -= count;
+    if( m_UsedBlocks < m_TrimLevel && m_TrimArmed ) {
+        trim();
+        }
+    }
+
+void MemoryPool::updateTrimLevel( void )
+    {
+    m_TrimLevel = ( uint32_t )( ( uint64_t )m_BlockCount * m_Config.trim_watermark / 100 );
+    }
+
+/**
+ * Releases the whole pages of the never used region with
+ * madvise( MADV_DONTNEED ). The region holds no free list links, so its
+ * contents may be dropped. Returns the number of bytes released.
+ */
+size_t MemoryPool::purgeBumpRegion( void )
+    {
+#ifdef MEM_POOL_HAS_MMAP
+    uintptr_t page = ( uintptr_t )sysconf( _SC_PAGESIZE );
+    uintptr_t start = ( ( uintptr_t )m_pBumpPtr + page - 1 ) & ~( page - 1 );
+    uintptr_t end = ( uintptr_t )m_pBumpEnd & ~( page - 1 );
+    if( m_pBumpPtr != NULL && end > start &&
+        madvise( ( void* )start, end - start, MADV_DONTNEED ) == 0 ) {
+        return end - start;
+        }
+#endif
+    return 0;
+    }
+
+// free_count of a chunk that trim() is about to release
+static const uint32_t kReleasedChunk = 0xFFFFFFFF;
+
+/**
+ * Aligned pools find the chunk by masking the address, header pools by a
+ * binary search of the chunk table.
+ */
+MemChunkStr* MemoryPool::findChunk( uint8_t* block_ptr )
+    {
+    if( m_Config.layout == MemPoolConfigStr::LAYOUT_ALIGNED ) {
+        return ( MemChunkStr* )( ( uintptr_t )block_ptr &
+            ~( uintptr_t )( kAlignedChunkBytes - 1 ) );
+        }
+    // Last chunk starting at or below the block
+    uint32_t low = 0;
+    uint32_t high = m_ChunkCount;
+    while( low < high ) {
+        uint32_t mid = ( low + high ) / 2;
+        if( ( uint8_t* )m_pChunkTable[ mid ] <= block_ptr ) {
+            low = mid + 1;
+            }
+        else {
+            high = mid;
+            }
+        }
+    if( low == 0 ) {
+        return NULL;
+        }
+    MemChunkStr* pChunk = m_pChunkTable[ low - 1 ];
+    uint8_t* pFirst = ( uint8_t* )pChunk + getChunkOffset();
+    if( block_ptr < pFirst ||
+        block_ptr >= pFirst + ( size_t )m_BlockStride * pChunk->block_count ) {
+        return NULL;
+        }
+    return pChunk;
+    }
+
+/**
+ * Unlinks the free blocks of the chunks marked for release, frees the
+ * chunks and removes them from the chunk list and table. Their blocks
+ * become uncommitted.
+ */
+size_t MemoryPool::releaseChunks( void )
+    {
+    size_t released = 0;
+    uint32_t offset = getChunkOffset();
+
+    uint8_t** ppLink = &m_pFreeMemBlock;
+    while( *ppLink != NULL ) {
+        uint8_t* pBlock = *ppLink;
+        MemChunkStr* pChunk = findChunk( pBlock );
+        if( pChunk != NULL && pChunk->free_count == kReleasedChunk ) {
+            *ppLink = ( uint8_t* )*getLink( pBlock );
+            }
+        else {
+            ppLink = ( uint8_t** )getLink( pBlock );
+            }
+        }
+    // The never used region belongs to the newest chunk
+    if( m_pChunks != NULL && m_pChunks->free_count == kReleasedChunk ) {
+        m_pBumpPtr = NULL;
+        m_pBumpEnd = NULL;
+        }
+
+    uint32_t kept = 0;
+    for( uint32_t i = 0; i < m_ChunkCount; i++ ) {
+        if( m_pChunkTable[ i ]->free_count != kReleasedChunk ) {
+            m_pChunkTable[ kept++ ] = m_pChunkTable[ i ];
+            }
+        }
+    MemChunkStr** ppChunk = &m_pChunks;
+    while( *ppChunk != NULL ) {
+        MemChunkStr* pChunk = *ppChunk;
+        if( pChunk->free_count != kReleasedChunk ) {
+            ppChunk = &pChunk->pNext;
+            continue;
+            }
+        *ppChunk = pChunk->pNext;
+        m_UncommittedBlocks += pChunk->block_count;
+        if( pChunk->map_bytes > 0 ) {
+            released += pChunk->map_bytes;
+            }
+        else if( m_Config.layout == MemPoolConfigStr::LAYOUT_ALIGNED ) {
+            released += kAlignedChunkBytes;
+            }
+        else {
+            released += offset + ( size_t )m_BlockStride * pChunk->block_count;
+            }
+        freeChunkMemory( pChunk );
+        }
+    m_ChunkCount = kept;
+    return released;
+    }
+
+/**
+ * Counts the free blocks of every chunk from the free list and the never
+ * used region, then releases the chunks with no blocks in use. The free
+ * list keeps its order without the blocks of the released chunks. The
+ * first chunk is kept as getPoolPtr() points into it, but when no block
+ * is in use its blocks are all made never used again, so that its pages
+ * are purged with the rest of the never used region.
+ */
+size_t MemoryPool::trim( void )
+    {
+    m_TrimArmed = false;
+    m_ChunkAllocFailed = false;
+    drainRemoteFrees();
+    size_t released = 0;
+    if( m_pChunks == NULL ) {
+        return 0;
+        }
+    MemChunkStr* pFirstChunk = m_pChunks;
+    while( pFirstChunk->pNext != NULL ) {
+        pFirstChunk = pFirstChunk->pNext;
+        }
+
+    if( m_UsedBlocks == 0 ) {
+        // Everything is free: no need to count
+        for( MemChunkStr* pChunk = m_pChunks; pChunk != NULL; pChunk = pChunk->pNext ) {
+            pChunk->free_count = pChunk != pFirstChunk ? kReleasedChunk : 0;
+            }
+        m_pFreeMemBlock = NULL;
+        released += releaseChunks();
+        m_pBumpPtr = ( uint8_t* )pFirstChunk + getChunkOffset();
+        m_pBumpEnd = m_pBumpPtr + ( size_t )m_BlockStride * pFirstChunk->block_count;
+        }
+    else if( m_ChunkCount > 1 ) {
+        for( MemChunkStr* pChunk = m_pChunks; pChunk != NULL; pChunk = pChunk->pNext ) {
+            pChunk->free_count = 0;
+            }
+        // The never used region belongs to the newest chunk
+        m_pChunks->free_count = ( uint32_t )( ( m_pBumpEnd - m_pBumpPtr ) / m_BlockStride );
+        for( uint8_t* pBlock = m_pFreeMemBlock; pBlock != NULL;
+             pBlock = ( uint8_t* )*getLink( pBlock ) ) {
+            MemChunkStr* pChunk = findChunk( pBlock );
+            if( pChunk != NULL ) {
+                pChunk->free_count++;
+                }
+            }
+        // Chunks to release, never the oldest one
+        bool any_released = false;
+        for( MemChunkStr* pChunk = m_pChunks; pChunk != pFirstChunk; pChunk = pChunk->pNext ) {
+            if( pChunk->free_count == pChunk->block_count ) {
+                pChunk->free_count = kReleasedChunk;
+                any_released = true;
+                }
+            }
+        if( any_released ) {
+            released += releaseChunks();
+            }
+        }
+    released += purgeBumpRegion();
+    return released;
+    }
+
+/*----------------------------------------------------------------------------*/
+/* class CompactMemoryPool see mem_pool.h */
+/*----------------------------------------------------------------------------*/
+
+CompactMemoryPool::CompactMemoryPool( uint32_t block_size, uint32_t block_count )
+    : m_pMemory( NULL ),
+      m_MapBytes( 0 ),
+      m_pSnapshot( NULL ),
+      m_LayoutHash( 0 ),
+      m_Restored( false ),
+      m_pPool( NULL ),
+      m_pAllocBits( NULL ),
+      m_BlockSize( block_size ),
+      m_BlockCount( block_count ),
+      m_FreeHead( kNullIndex ),
+      m_BumpIndex( 0 ),
+      m_UsedBlocks( 0 ),
+      m_PoolId( 0 ) {
+
+    assert( block_size >= sizeof( uint32_t ) &&
+        "Error: Block size must be big enough to hold one block index when the block is not used\n" );
+    assert( block_count < kNullIndex && "Error: Too many blocks for 32-bit indices\n" );
+
+    // Keep the link word of every block aligned
+    m_BlockStride = ( block_size + sizeof( uint32_t ) - 1 ) &
+        ~( uint32_t )( sizeof( uint32_t ) - 1 );
+
+    // The bitmap must start cleared, the blocks are left untouched
+    m_pMemory = ( uint8_t* )calloc( 1, getBitmapBytes() + ( size_t )m_BlockStride * block_count );
+    assert( m_pMemory && "ERROR: could not allocate memory for the pool" );
+    m_pAllocBits = ( uint32_t* )m_pMemory;
+    m_pPool = m_pMemory + getBitmapBytes();
+}
+
+CompactMemoryPool::CompactMemoryPool( uint32_t block_size, uint32_t block_count,
+    const char* file_path, uint32_t version, uint64_t layout_hash )
+    : m_pMemory( NULL ),
+      m_MapBytes( 0 ),
+      m_pSnapshot( NULL ),
+      m_LayoutHash( 0 ),
+      m_Restored( false ),
+      m_pPool( NULL ),
+      m_pAllocBits( NULL ),
+      m_BlockSize( block_size ),
+      m_BlockCount( block_count ),
+      m_FreeHead( kNullIndex ),
+      m_BumpIndex( 0 ),
+      m_UsedBlocks( 0 ),
+      m_PoolId( 0 ) {
+
+    assert( block_size >= sizeof( uint32_t ) &&
+        "Error: Block size must be big enough to hold one block index when the block is not used\n" );
+    assert( block_count < kNullIndex && "Error: Too many blocks for 32-bit indices\n" );
+
+    m_BlockStride = ( block_size + sizeof( uint32_t ) - 1 ) &
+        ~( uint32_t )( sizeof( uint32_t ) - 1 );
+
+    // The pool's own geometry is part of the layout
+    uint32_t geometry[ 3 ] = { block_size, m_BlockStride, block_count };
+    m_LayoutHash = hashLayout( geometry, sizeof( geometry ), layout_hash );
+
+    if( !mapSnapshot( file_path, version ) ) {
+        m_pMemory = ( uint8_t* )calloc( 1, getBitmapBytes() + ( size_t )m_BlockStride * block_count );
+        assert( m_pMemory && "ERROR: could not allocate memory for the pool" );
+        m_pAllocBits = ( uint32_t* )m_pMemory;
+        m_pPool = m_pMemory + getBitmapBytes();
+    }
+}
+
+CompactMemoryPool::~CompactMemoryPool( void ) {
+    if( m_pSnapshot != NULL ) {
+#ifdef MEM_POOL_HAS_MMAP
+        sync();
+        munmap( m_pMemory, m_MapBytes );
+#endif
+    }
+    else {
+        free( m_pMemory );
+    }
+}
+
+uint64_t CompactMemoryPool::hashLayout( const void* data, size_t bytes, uint64_t hash ) {
+    const uint8_t* byte_ptr = ( const uint8_t* )data;
+    for( size_t i = 0; i < bytes; i++ ) {
+        hash ^= byte_ptr[ i ];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * Maps the file shared, so that the blocks are written back to it by the
+ * kernel. The file is sized for the pool; if it already held a matching,
+ * clean snapshot with a valid pool state, the state is read from the
+ * header and the bitmap and blocks are used as they are. Any other file
+ * is cleared.
+ */
+bool CompactMemoryPool::mapSnapshot( const char* file_path, uint32_t version ) {
+#ifdef MEM_POOL_HAS_MMAP
+    size_t map_bytes = kSnapshotHeaderBytes + getBitmapBytes() +
+        ( size_t )m_BlockStride * m_BlockCount;
+    int fd = open( file_path, O_RDWR | O_CREAT, 0644 );
+    if( fd < 0 ) {
+        return false;
+    }
+    struct stat file_stat;
+    bool match = false;
+    if( fstat( fd, &file_stat ) == 0 && ( size_t )file_stat.st_size == map_bytes ) {
+        SnapshotHeaderStr header;
+        match = pread( fd, &header, sizeof( header ), 0 ) == ( ssize_t )sizeof( header ) &&
+            header.magic == kSnapshotMagic && header.format == kSnapshotFormat &&
+            header.version == version && header.layout_hash == m_LayoutHash &&
+            header.block_size == m_BlockSize && header.block_count == m_BlockCount &&
+            header.clean != 0 && header.bump_index <= m_BlockCount &&
+            header.used_blocks <= header.bump_index &&
+            ( header.free_head == kNullIndex || header.free_head < header.bump_index );
+    }
+    if( !match ) {
+        // Truncating first clears the old contents, bitmap included
+        if( ftruncate( fd, 0 ) != 0 || ftruncate( fd, map_bytes ) != 0 ) {
+            close( fd );
+            return false;
+        }
+    }
+    void* map_ptr = mmap( NULL, map_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    close( fd );
+    if( map_ptr == MAP_FAILED ) {
+        return false;
+    }
+
+    m_pMemory = ( uint8_t* )map_ptr;
+    m_MapBytes = map_bytes;
+    m_pSnapshot = ( SnapshotHeaderStr* )m_pMemory;
+    m_pAllocBits = ( uint32_t* )( m_pMemory + kSnapshotHeaderBytes );
+    m_pPool = m_pMemory + kSnapshotHeaderBytes + getBitmapBytes();
+    if( match ) {
+        m_FreeHead = m_pSnapshot->free_head;
+        m_BumpIndex = m_pSnapshot->bump_index;
+        m_UsedBlocks = m_pSnapshot->used_blocks;
+        m_Restored = true;
+    }
+    m_pSnapshot->magic = kSnapshotMagic;
+    m_pSnapshot->format = kSnapshotFormat;
+    m_pSnapshot->version = version;
+    m_pSnapshot->block_size = m_BlockSize;
+    m_pSnapshot->block_count = m_BlockCount;
+    m_pSnapshot->layout_hash = m_LayoutHash;
+    sync();
+    return true;
+#else
+    ( void )file_path;
+    ( void )version;
+    return false;
+#endif
+}
+
+void CompactMemoryPool::sync( void ) {
+#ifdef MEM_POOL_HAS_MMAP
+    if( m_pSnapshot == NULL ) {
+        return;
+    }
+    m_pSnapshot->free_head = m_FreeHead;
+    m_pSnapshot->bump_index = m_BumpIndex;
+    m_pSnapshot->used_blocks = m_UsedBlocks;
+    // The header may only claim to be clean once the blocks are on disk
+    if( msync( m_pMemory, m_MapBytes, MS_SYNC ) == 0 ) {
+        m_pSnapshot->clean = 1;
+        msync( m_pMemory, kSnapshotHeaderBytes, MS_SYNC );
+    }
+#endif
+}
+
+void CompactMemoryPool::markDirty( void ) {
+#ifdef MEM_POOL_HAS_MMAP
+    m_pSnapshot->clean = 0;
+    msync( m_pMemory, kSnapshotHeaderBytes, MS_SYNC );
+#endif
+}
+
+/**
+ * Pops the first block of the free list, or carves a never used block
+ * when the list is empty.
+ */
+void* CompactMemoryPool::alloc( void ) {
+    if( isSnapshotClean() ) {
+        markDirty();
+    }
+    uint32_t index = m_FreeHead;
+    if( index != kNullIndex ) {
+        m_FreeHead = *getLink( index );
+    }
+    else if( m_BumpIndex < m_BlockCount ) {
+        index = m_BumpIndex++;
+    }
+    else {
+        return NULL;
+    }
+    m_pAllocBits[ index >> 5 ] |= 1u << ( index & 31 );
+    m_UsedBlocks++;
+    return m_pPool + ( size_t )index * m_BlockStride;
+}
+
+/**
+ * Pushes the block on top of the free list.
+ */
+void CompactMemoryPool::dealloc( void* ptr ) {
+    uint32_t index = getBlockIndex( ptr );
+    assert( isAllocated( ptr ) && "Error: Block is not allocated\n" );
+    if( isSnapshotClean() ) {
+        markDirty();
+    }
+    m_pAllocBits[ index >> 5 ] &= ~( 1u << ( index & 31 ) );
+    *getLink( index ) = m_FreeHead;
+    m_FreeHead = index;
+    m_UsedBlocks--;
+}
+
+/*----------------------------------------------------------------------------*/
+/* class FrameArena see mem_pool.h */
+/*----------------------------------------------------------------------------*/
+
+FrameArena::FrameArena( uint32_t capacity, bool double_buffered )
+    : m_Capacity( capacity ),
+      m_Current( 0 ),
+      m_Offset( 0 ),
+      m_PeakUsage( 0 ) {
+    m_pBuffers[ 0 ] = ( uint8_t* )malloc( capacity );
+    m_pBuffers[ 1 ] = double_buffered ? ( uint8_t* )malloc( capacity ) : NULL;
+    assert( m_pBuffers[ 0 ] != NULL && "Error: Could not allocate frame arena\n" );
+}
+
+FrameArena::~FrameArena( void ) {
+    free( m_pBuffers[ 0 ] );
+    free( m_pBuffers[ 1 ] );
+}
+
+/**
+ * Frees everything allocated from the current buffer by rewinding
+ * the offset.
+ */
+void FrameArena::reset( void ) {
+    if( m_Offset > m_PeakUsage ) {
+        m_PeakUsage = m_Offset;
+    }
+    m_Offset = 0;
+}
+
+/**
+ * Makes the other buffer current and resets it. The buffer of the frame
+ * that just ended is left untouched until the next swap.
+ */
+void FrameArena::swap( void ) {
+    reset();
+    if( m_pBuffers[ 1 ] != NULL ) {
+        m_Current ^= 1;
+    }
+}
+
+bool FrameArena::contains( const void* ptr ) {
+    for( uint32_t i = 0; i < 2; i++ ) {
+        const uint8_t* pBuffer = m_pBuffers[ i ];
+        if( pBuffer != NULL && ( const uint8_t* )ptr >= pBuffer &&
+            ( const uint8_t* )ptr < pBuffer + m_Capacity ) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*----------------------------------------------------------------------------*/
+/* class StackAllocator see mem_pool.h */
+/*----------------------------------------------------------------------------*/
+
+StackAllocator::StackAllocator( uint32_t capacity )
+    : m_Capacity( capacity ),
+      m_Bottom( 0 ),
+      m_Top( capacity ) {
+    m_pBuffer = ( uint8_t* )malloc( capacity );
+    assert( m_pBuffer != NULL && "Error: Could not allocate stack allocator\n" );
+}
+
+StackAllocator::~StackAllocator( void ) {
+    free( m_pBuffer );
+}
+
+/**
+ * Allocates from the bottom end, which grows towards the top end.
+ */
+void* StackAllocator::alloc( uint32_t bytes, uint32_t alignment ) {
+    uintptr_t base = ( uintptr_t )m_pBuffer;
+    uintptr_t ptr = ( base + m_Bottom + alignment - 1 ) &
+        ~( uintptr_t )( alignment - 1 );
+    if( ptr + bytes > base + m_Top ) {
+        return NULL;
+    }
+    m_Bottom = ( uint32_t )( ptr + bytes - base );
+    return ( void* )ptr;
+}
+
+/**
+ * Allocates from the top end, which grows towards the bottom end.
+ */
+void* StackAllocator::allocTop( uint32_t bytes, uint32_t alignment ) {
+    uintptr_t base = ( uintptr_t )m_pBuffer;
+    if( bytes > m_Top ) {
+        return NULL;
+    }
+    uintptr_t ptr = ( base + m_Top - bytes ) & ~( uintptr_t )( alignment - 1 );
+    if( ptr < base + m_Bottom ) {
+        return NULL;
+    }
+    m_Top = ( uint32_t )( ptr - base );
+    return ( void* )ptr;
+}
+
+void StackAllocator::freeToMarker( Marker marker ) {
+    assert( marker <= m_Bottom && "Error: Marker is above the bottom end\n" );
+    m_Bottom = marker;
+}
+
+void StackAllocator::freeToTopMarker( Marker marker ) {
+    assert( marker >= m_Top && "Error: Marker is below the top end\n" );
+    m_Top = marker;
+}
+
+/*----------------------------------------------------------------------------*/
+/* class ConcurrentMemoryPool see mem_pool.h */
+/*----------------------------------------------------------------------------*/
+
+ConcurrentMemoryPool::ConcurrentMemoryPool(
+    uint32_t block_size, uint32_t block_count )
+    : m_BlockSize( block_size ),
+      m_BlockCount( block_count ),
+      m_PoolId( 0 ) {
+
+    assert( block_size >= sizeof( uint32_t ) &&
+        "Error: Block size must be big enough to hold one block index when the block is not used\n" );
+
+    // Every block starts at the fundamental alignment of the malloc'd pool,
+    // so the payload is at least pointer aligned like in MemoryPool
+    const uint32_t align = ( uint32_t )alignof( std::max_align_t );
+    m_BlockStride = SIZE_MEM_BLOCK_HEADER + block_size;
+    m_BlockStride = ( m_BlockStride + align - 1 ) & ~( align - 1 );
+
+    m_pPool = malloc( ( size_t )m_BlockStride * block_count );
+    assert( m_pPool && "ERROR: could not allocate memory for the pool" );
+
+    // Link every block to the next one, the last one ends the list
+    for( uint32_t i = 0; i < block_count; i++ ) {
+        MemBlockStr* pBlock = getBlock( i );
+        pBlock->header = 0;
+        new( getLink( pBlock ) ) std::atomic< uint32_t >(
+            i < block_count - 1 ? i + 1 : kNullIndex );
+    }
+    m_FreeHead.store( block_count > 0 ? 0 : kNullIndex );
+    m_FreeCount.store( block_count );
+}
+
+ConcurrentMemoryPool::~ConcurrentMemoryPool( void )
+    {
+    if( m_pPool )
+        {
+        free( m_pPool );
+        }
+    }
+
+/**
+ * Pops the first block from the free stack.
+ * The link of the head block is read before the CAS. If another thread
+ * pops the block and pushes it back in the meantime, the tag of the head
+ * has changed and the CAS fails, so a stale link is never installed.
+ */
+void* ConcurrentMemoryPool::alloc( void )
+    {
+    uint64_t head = m_FreeHead.load( std::memory_order_acquire );
+    uint64_t new_head;
+    MemBlockStr* pBlock;
+    do {
+        uint32_t index = ( uint32_t )head;
+        if( index == kNullIndex ) {
+            return NULL;
+            }
+        pBlock = getBlock( index );
+        uint32_t next = getLink( pBlock )->load( std::memory_order_relaxed );
+        new_head = ( ( head >> 32 ) + 1 ) << 32 | next;
+        } while( !m_FreeHead.compare_exchange_weak( head, new_head,
+            std::memory_order_acquire, std::memory_order_acquire ) );
+
+    m_FreeCount.fetch_sub( 1, std::memory_order_relaxed );
 
     // put pool id as header data and set the MSB to indicate that
     // this blocks is reserved.
@@ -100,47 +1135,63 @@ void* MemoryPool::alloc( void )
     }
 
 /**
- * Frees one block in the pool and adds it to the head of the free block list.
+ * Pushes the block on top of the free stack.
  */
-void MemoryPool::dealloc( void* ptr )
+void ConcurrentMemoryPool::dealloc( void* ptr )
     {
     MemBlockStr* pBlock = ( MemBlockStr* )(
         ( uint8_t* )ptr - SIZE_MEM_BLOCK_HEADER );
-    pBlock->pData = ( void* )m_pFreeMemBlock;
+    uint32_t index = ( uint32_t )(
+        ( ( uint8_t* )pBlock - ( uint8_t* )m_pPool ) / m_BlockStride );
     pBlock->header &= ~( 1 << 31 );
-    m_pFreeMemBlock = pBlock;
-    }
-
-/* Calculates the number of free memory blocks */
-uint32_t MemoryPool::getFreeBlockCount( void ) {
-
-    uint32_t count = 0;
 
-    if( m_pFreeMemBlock == NULL ) {
-       return count;
-    }
+    uint64_t head = m_FreeHead.load( std::memory_order_relaxed );
+    uint64_t new_head;
+    do {
+        getLink( pBlock )->store( ( uint32_t )head, std::memory_order_relaxed );
+        new_head = ( ( head >> 32 ) + 1 ) << 32 | index;
+        } while( !m_FreeHead.compare_exchange_weak( head, new_head,
+            std::memory_order_release, std::memory_order_relaxed ) );
 
-    MemBlockStr* pBlock = m_pFreeMemBlock;
-    while( pBlock != NULL ) {
-    if( !( pBlock->header & ( 1 << 31 ) ) ) {
-        count++;
+    m_FreeCount.fetch_add( 1, std::memory_order_relaxed );
     }
-        pBlock = ( MemBlockStr* )pBlock->pData;
-    }
-    return count;
-}
 
 /*----------------------------------------------------------------------------*/
 /* class MemPoolManager see mem_pool.h */
 /*----------------------------------------------------------------------------*/
 
-MemPoolManager::MemPoolManager():  m_PoolIdCounter( 0 ){
+MemPoolManager::MemPoolManager( MemPoolConfigStr::LayoutEnum layout ) :
+    m_Layout( layout ), m_pSizeClasses( NULL ),
+    m_SizeClassCount( 0 ), m_pSizeClassTable( NULL ), m_SizeClassTableLen( 0 ),
+    m_ThreadCaching( false ), m_pCacheList( NULL ), m_CacheSlot( acquireCacheSlot() ),
+    m_pProfile( NULL ), m_Profiling( false ), m_pTags( NULL ), m_Telemetry( false ),
+    m_TelemetryCounted( false ),
+    m_LiveBlocks( 0 ), m_PeakBlocks( 0 ), m_LiveBytes( 0 ), m_PeakBytes( 0 ),
+    m_FailedAllocs( 0 ), m_Fallthroughs( 0 ), m_RequestedBytes( 0 ), m_WastedBytes( 0 ) {
     m_PoolList.pHead = NULL;
     m_PoolList.pTail = NULL;
+    memset( m_PoolTable, 0, sizeof( m_PoolTable ) );
+    memset( m_PoolSizeClass, 0, sizeof( m_PoolSizeClass ) );
 }
 
 MemPoolManager::~MemPoolManager() {
+    // Detach remaining caches so that their threads do not flush into
+    // destroyed pools on exit.
+    {
+        std::lock_guard< std::mutex > guard( m_CacheListLock );
+        ThreadCache* cache_ptr = m_pCacheList;
+        while( cache_ptr != NULL ) {
+            cache_ptr->m_pManager = NULL;
+            cache_ptr = cache_ptr->m_pNext;
+        }
+        m_pCacheList = NULL;
+    }
+    releaseCacheSlot( m_CacheSlot );
     clearAllPools();
+    delete[] m_pSizeClasses;
+    delete[] m_pSizeClassTable;
+    delete[] m_pProfile;
+    delete[] m_pTags;
 }
 
 /**
@@ -173,6 +1224,10 @@ void MemPoolManager::insertPoolNode( MemPoolNodeStr* node_ptr ) {
             if( temp_node_ptr->pPrev != NULL ) {
                 temp_node_ptr->pPrev->pNext = node_ptr;
             }
+            // Smallest block size so far, the node becomes the new head
+            else {
+                m_PoolList.pHead = node_ptr;
+            }
             temp_node_ptr->pPrev = node_ptr;
         }
         // Add to the end of the list
@@ -207,34 +1262,86 @@ void MemPoolManager::removePoolNode( MemPoolNodeStr* node_ptr ) {
         m_PoolList.pTail = node_ptr->pPrev;
     }
 
-    // Update adjacent nodes
-    if( node_ptr->pPrev != NULL ) {
-        node_ptr->pPrev->pNext = node_ptr->pNext;
+    // Update adjacent nodes
+    if( node_ptr->pPrev != NULL ) {
+        node_ptr->pPrev->pNext = node_ptr->pNext;
+    }
+    if( node_ptr->pNext != NULL ) {
+        node_ptr->pNext->pPrev = node_ptr->pPrev;
+    }
+}
+
+/**
+ * Rebuilds the size class array and the request size lookup table.
+ * Called whenever pools are added or removed.
+ */
+void MemPoolManager::rebuildSizeClasses( void ) {
+    delete[] m_pSizeClasses;
+    delete[] m_pSizeClassTable;
+    m_pSizeClasses = NULL;
+    m_pSizeClassTable = NULL;
+    m_SizeClassTableLen = 0;
+
+    m_SizeClassCount = getPoolCount();
+    if( m_SizeClassCount == 0 ) {
+        return;
+    }
+
+    m_pSizeClasses = new MemoryPool*[ m_SizeClassCount ];
+    MemPoolNodeStr* node_ptr = m_PoolList.pHead;
+    for( uint16_t i = 0; i < m_SizeClassCount; i++ ) {
+        m_pSizeClasses[ i ] = node_ptr->pPool;
+        m_PoolSizeClass[ node_ptr->pPool->getPoolId() ] = i;
+        node_ptr = node_ptr->pNext;
+    }
+
+    uint32_t max_bytes = m_pSizeClasses[ m_SizeClassCount - 1 ]->getBlockSize();
+    if( max_bytes > kMaxSizeClassTableBytes ) {
+        max_bytes = kMaxSizeClassTableBytes;
     }
-    if( node_ptr->pNext != NULL ) {
-        node_ptr->pNext->pPrev = node_ptr->pPrev;
+    m_SizeClassTableLen = max_bytes / kSizeClassGranularity + 1;
+    m_pSizeClassTable = new uint16_t[ m_SizeClassTableLen ];
+
+    // Entry of each slot points to the first class that fits the smallest
+    // request of the slot; findSizeClass steps over the rest.
+    uint16_t index = 0;
+    m_pSizeClassTable[ 0 ] = 0;
+    for( uint32_t slot = 1; slot < m_SizeClassTableLen; slot++ ) {
+        uint32_t min_bytes = ( slot - 1 ) * kSizeClassGranularity + 1;
+        while( index < m_SizeClassCount &&
+               m_pSizeClasses[ index ]->getBlockSize() < min_bytes ) {
+            index++;
+        }
+        m_pSizeClassTable[ slot ] = index;
     }
 }
 
 /**
  * Adds a new pool to the list of memory pools and assigns id to it.
+ * The id is the lowest free slot in the pool table.
  */
 bool MemPoolManager::addPool( MemoryPool* pool_ptr ) {
+    if( pool_ptr->getLayout() != m_Layout ) {
+        return false; // dealloc could not find the pool of its blocks
+    }
+    uint16_t id = 0;
+    while( id < kMaxPoolCount && m_PoolTable[ id ] != NULL ) {
+        id++;
+    }
+    if( id == kMaxPoolCount ) {
+        return false; // No free pool ids left
+    }
     // Create new node for the pool list
     MemPoolNodeStr* node_ptr = new MemPoolNodeStr;
     if( node_ptr == NULL ) {
         return false; // Could not allocate memory for node
     }
-    // Add it to the end of the list and set id
+    // Add it to the list and set id
     node_ptr->pPool = pool_ptr;
     insertPoolNode( node_ptr );
-    if( node_ptr->pPrev != NULL ) {
-        pool_ptr->setPoolId( m_PoolIdCounter++ );
-    }
-    else {
-        m_PoolIdCounter = 0;
-        pool_ptr->setPoolId( m_PoolIdCounter++ );
-    }
+    pool_ptr->setPoolId( id );
+    m_PoolTable[ id ] = pool_ptr;
+    rebuildSizeClasses();
     return true;
 }
 
@@ -248,11 +1355,13 @@ bool MemPoolManager::removePool( uint16_t id ) {
     while( node_ptr != NULL ) {
         if( node_ptr->pPool->getPoolId() == id ) {
             // Destroy the pool
+            m_PoolTable[ id ] = NULL;
             delete node_ptr->pPool;
             node_ptr->pPool = NULL;
             // Update pool list and delete node
             removePoolNode( node_ptr );
             delete node_ptr;
+            rebuildSizeClasses();
 
             return true;
         }
@@ -271,11 +1380,13 @@ bool MemPoolManager::removePoolByBlockSize( uint32_t size ) {
     while( node_ptr != NULL ) {
         if( node_ptr->pPool->getBlockSize() == size ) {
             // Destroy the pool
+            m_PoolTable[ node_ptr->pPool->getPoolId() ] = NULL;
             delete node_ptr->pPool;
             node_ptr->pPool = NULL;
             // Update pool list and delete node
             removePoolNode( node_ptr );
             delete node_ptr;
+            rebuildSizeClasses();
 
             return true;
         }
@@ -306,6 +1417,7 @@ void MemPoolManager::clearAllPools( void ) {
     MemPoolNodeStr* node_ptr = m_PoolList.pHead;
     while( node_ptr != NULL ) {
         // Destroy the pool
+        m_PoolTable[ node_ptr->pPool->getPoolId() ] = NULL;
         delete node_ptr->pPool;
         node_ptr->pPool = NULL;
         // Update pool list and delete node
@@ -315,47 +1427,775 @@ void MemPoolManager::clearAllPools( void ) {
 
         node_ptr = next_node_ptr;
     }
+    rebuildSizeClasses();
 }
 
 /**
  * Finds the most suitable pool for allocating given amount of bytes.
- * Pools are ordered in the list based on increasing block sizes and
- * search is started from the pool with smallest block size.
+ * The first size class large enough is taken from the lookup table, and
+ * if that pool is full or can not grow, the next larger pools are tried
+ * in order.
  */
-void* MemPoolManager::alloc( uint32_t bytes ) {
-    // Find the first pool which block size is large enough
-    MemPoolNodeStr* node_ptr = m_PoolList.pHead;
-    while( node_ptr != NULL &&
-           node_ptr->pPool->getBlockSize() < bytes ) {
-        node_ptr = node_ptr->pNext;
+void* MemPoolManager::alloc( uint32_t bytes, uint8_t tag ) {
+    void* ptr = NULL;
+    if( m_ThreadCaching ) {
+        ptr = getThreadCache()->alloc( bytes );
     }
-    // Try to allocate block from the pool
-    void* ret_ptr = NULL;
-    while( node_ptr != NULL &&
-        ( ret_ptr = node_ptr->pPool->alloc() ) == NULL ) {
-        node_ptr = node_ptr->pNext; // Pool is full, jump to next pool (larger one)
+    else {
+        uint16_t first = findSizeClass( bytes );
+        for( uint16_t i = first; i < m_SizeClassCount; i++ ) {
+            MemoryPool* pool_ptr = m_pSizeClasses[ i ];
+            // A growing pool can still fail when its next chunk can not be
+            // allocated. allocBatch() reports that without asserting.
+            if( !pool_ptr->isExhausted() && pool_ptr->allocBatch( &ptr, 1 ) == 1 ) {
+                if( i != first ) {
+                    m_Fallthroughs.fetch_add( 1, std::memory_order_relaxed );
+                }
+                break;
+            }
+            // Pool is full, jump to next pool (larger one)
+        }
+    }
+    if( ptr == NULL ) {
+        m_FailedAllocs.fetch_add( 1, std::memory_order_relaxed );
+        return NULL;
+    }
+    if( m_Profiling ) {
+        recordAlloc( ptr, bytes );
+    }
+    if( m_Telemetry ) {
+        recordTelemetryAlloc( ptr, bytes, tag );
     }
-    // Return valid pointer the allocation was successfull, otherwise NULL
-    return ret_ptr;
+    return ptr;
 }
 
 /**
  * Deallocates the given address. Casts the address into MemBlockStr
- * and selects the correct pool based on the id in the block header.
+ * and selects the correct pool from the pool table based on the id in
+ * the block header. Managers of aligned pools find the pool from the
+ * chunk header instead.
  */
 void MemPoolManager::dealloc( void* ptr ) {
-    // Parse pool id from the memory block
+    if( m_Profiling ) {
+        recordDealloc( ptr );
+    }
+    if( m_TelemetryCounted ) {
+        recordTelemetryDealloc( ptr );
+    }
+    if( m_ThreadCaching ) {
+        getThreadCache()->dealloc( ptr );
+        return;
+    }
+    MemoryPool* pool_ptr = getBlockPool( ptr );
+    if( pool_ptr == NULL ) {
+        return; //TODO: Failed deallocation
+    }
+    pool_ptr->dealloc( ptr );
+}
+
+/**
+ * Allocates a batch of blocks of the same size. The size class is looked
+ * up once; when a pool runs out, the rest of the batch comes from the
+ * next larger pools. With thread caching enabled the blocks come from the
+ * calling thread's cache one by one.
+ */
+uint32_t MemPoolManager::allocBatch( uint32_t bytes, uint32_t count, void** ptr_array,
+    uint8_t tag ) {
+    uint32_t done = 0;
+    if( m_ThreadCaching ) {
+        ThreadCache* cache_ptr = getThreadCache();
+        while( done < count &&
+               ( ptr_array[ done ] = cache_ptr->alloc( bytes ) ) != NULL ) {
+            done++;
+        }
+    }
+    else {
+        uint16_t first = findSizeClass( bytes );
+        for( uint16_t i = first; i < m_SizeClassCount && done < count; i++ ) {
+            uint32_t n = m_pSizeClasses[ i ]->allocBatch( ptr_array + done, count - done );
+            if( i != first ) {
+                m_Fallthroughs.fetch_add( n, std::memory_order_relaxed );
+            }
+            done += n;
+        }
+    }
+    if( done < count ) {
+        m_FailedAllocs.fetch_add( count - done, std::memory_order_relaxed );
+    }
+    if( m_Profiling ) {
+        for( uint32_t i = 0; i < done; i++ ) {
+            recordAlloc( ptr_array[ i ], bytes );
+        }
+    }
+    if( m_Telemetry ) {
+        for( uint32_t i = 0; i < done; i++ ) {
+            recordTelemetryAlloc( ptr_array[ i ], bytes, tag );
+        }
+    }
+    return done;
+}
+
+/**
+ * Deallocates a batch of blocks. Runs of blocks owned by the same pool
+ * are handed to MemoryPool::deallocBatch together.
+ */
+void MemPoolManager::deallocBatch( void** ptr_array, uint32_t count ) {
+    if( m_Profiling ) {
+        for( uint32_t i = 0; i < count; i++ ) {
+            recordDealloc( ptr_array[ i ] );
+        }
+    }
+    if( m_TelemetryCounted ) {
+        for( uint32_t i = 0; i < count; i++ ) {
+            recordTelemetryDealloc( ptr_array[ i ] );
+        }
+    }
+    if( m_ThreadCaching ) {
+        ThreadCache* cache_ptr = getThreadCache();
+        for( uint32_t i = 0; i < count; i++ ) {
+            cache_ptr->dealloc( ptr_array[ i ] );
+        }
+        return;
+    }
+    uint32_t start = 0;
+    while( start < count ) {
+        MemoryPool* pool_ptr = getBlockPool( ptr_array[ start ] );
+        uint32_t end = start + 1;
+        while( end < count && getBlockPool( ptr_array[ end ] ) == pool_ptr ) {
+            end++;
+        }
+        if( pool_ptr != NULL ) {
+            pool_ptr->deallocBatch( ptr_array + start, end - start );
+        }
+        start = end;
+    }
+}
+
+/**
+ * Trims every pool while holding its lock, so that it is safe while
+ * thread caches are refilling and flushing. Pools bound to another
+ * owner thread are skipped, as only the owner may trim them.
+ */
+size_t MemPoolManager::trim( void ) {
+    size_t released = 0;
+    for( uint16_t i = 0; i < m_SizeClassCount; i++ ) {
+        MemoryPool* pool_ptr = m_pSizeClasses[ i ];
+        std::thread::id owner = pool_ptr->getOwnerThread();
+        if( owner != std::thread::id() && owner != std::this_thread::get_id() ) {
+            continue;
+        }
+        std::lock_guard< std::mutex > guard( pool_ptr->getLock() );
+        released += pool_ptr->trim();
+    }
+    return released;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Profiling of MemPoolManager */
+/*----------------------------------------------------------------------------*/
+
+bool MemPoolManager::setProfiling( bool enable ) {
+    if( enable && m_Layout != MemPoolConfigStr::LAYOUT_HEADER ) {
+        return false;
+    }
+    if( enable ) {
+        if( m_pProfile == NULL ) {
+            m_pProfile = new MemPoolProfileEntryStr[ kProfileBucketCount ];
+        }
+        for( uint32_t i = 0; i < kProfileBucketCount; i++ ) {
+            m_pProfile[ i ].requests = 0;
+            m_pProfile[ i ].live = 0;
+            m_pProfile[ i ].peak = 0;
+        }
+    }
+    m_Profiling = enable;
+    return true;
+}
+
+/**
+ * Counts the request and raises the peak of its histogram entry if
+ * needed. The entry is stored in the block header for recordDealloc.
+ */
+void MemPoolManager::recordAlloc( void* ptr, uint32_t bytes ) {
+    uint32_t bucket = getProfileBucket( bytes );
     MemBlockStr* block_ptr = ( MemBlockStr* )( ( uint8_t* )ptr - SIZE_MEM_BLOCK_HEADER );
-    uint16_t pool_id = block_ptr->header & 0xFFFF;
+    block_ptr->header = ( block_ptr->header & 0xC000FFFF ) | ( bucket << 16 );
 
-    // Find the correct pool and call dealloc
-    MemPoolNodeStr* node_ptr = m_PoolList.pHead;
-    while( node_ptr != NULL ) {
-        if( node_ptr->pPool->getPoolId() == pool_id ) {
-            node_ptr->pPool->dealloc( ptr );
-            return; // Function exists here on success
+    MemPoolProfileEntryStr* entry_ptr = &m_pProfile[ bucket ];
+    entry_ptr->requests.fetch_add( 1, std::memory_order_relaxed );
+    uint32_t live = entry_ptr->live.fetch_add( 1, std::memory_order_relaxed ) + 1;
+    uint32_t peak = entry_ptr->peak.load( std::memory_order_relaxed );
+    while( live > peak &&
+           !entry_ptr->peak.compare_exchange_weak( peak, live,
+               std::memory_order_relaxed ) ) {
+    }
+}
+
+/**
+ * Decrements the live count of the block's histogram entry. Blocks
+ * allocated before profiling was enabled carry no entry.
+ */
+void MemPoolManager::recordDealloc( void* ptr ) {
+    MemBlockStr* block_ptr = ( MemBlockStr* )( ( uint8_t* )ptr - SIZE_MEM_BLOCK_HEADER );
+    uint32_t bucket = ( block_ptr->header >> 16 ) & 0x3FFF;
+    if( bucket == 0 || bucket >= kProfileBucketCount ) {
+        return;
+    }
+    block_ptr->header &= 0xC000FFFF;
+    std::atomic< uint32_t >& live = m_pProfile[ bucket ].live;
+    uint32_t count = live.load( std::memory_order_relaxed );
+    while( count > 0 &&
+           !live.compare_exchange_weak( count, count - 1,
+               std::memory_order_relaxed ) ) {
+    }
+}
+
+uint32_t MemPoolManager::getProfiledRequests( uint32_t bytes ) {
+    return m_pProfile != NULL ? m_pProfile[ getProfileBucket( bytes ) ].requests.load() : 0;
+}
+
+uint32_t MemPoolManager::getProfiledPeak( uint32_t bytes ) {
+    return m_pProfile != NULL ? m_pProfile[ getProfileBucket( bytes ) ].peak.load() : 0;
+}
+
+/**
+ * Splits the recorded sizes into at most max_pools classes. A class
+ * serves the sizes from the one after the previous class up to its own
+ * size, and wastes ( class size - request size ) bytes per block. The
+ * split with the least waste at peak is found by dynamic programming
+ * over the sizes that were requested. Requests above
+ * kMaxSizeClassTableBytes are not covered.
+ */
+uint16_t MemPoolManager::recommendPools( MemPoolSpecStr* spec_array,
+    uint16_t max_pools, uint32_t headroom_percent ) {
+    if( m_pProfile == NULL || max_pools == 0 ) {
+        return 0;
+    }
+    // Sizes with a non-zero peak, in increasing order
+    uint32_t* size_array = new uint32_t[ kProfileBucketCount ];
+    uint64_t* peak_array = new uint64_t[ kProfileBucketCount ];
+    uint32_t n = 0;
+    for( uint32_t b = 1; b < kProfileBucketCount - 1; b++ ) {
+        uint32_t peak = m_pProfile[ b ].peak.load();
+        if( peak > 0 ) {
+            size_array[ n ] = b * kSizeClassGranularity;
+            peak_array[ n ] = peak;
+            n++;
         }
-        node_ptr = node_ptr->pNext;
     }
-    //TODO: Failed deallocation
+    uint16_t class_count = max_pools < n ? max_pools : ( uint16_t )n;
+    if( class_count == 0 ) {
+        delete[] size_array;
+        delete[] peak_array;
+        return 0;
+    }
+
+    // Prefix sums of peaks and of peak * size give the waste of any
+    // class in O(1)
+    uint64_t* peak_sum = new uint64_t[ n + 1 ];
+    uint64_t* bytes_sum = new uint64_t[ n + 1 ];
+    peak_sum[ 0 ] = 0;
+    bytes_sum[ 0 ] = 0;
+    for( uint32_t i = 0; i < n; i++ ) {
+        peak_sum[ i + 1 ] = peak_sum[ i ] + peak_array[ i ];
+        bytes_sum[ i + 1 ] = bytes_sum[ i ] + peak_array[ i ] * size_array[ i ];
+    }
+
+    // waste[ k * n + i ]: least waste of sizes 0..i in k + 1 classes,
+    // first[ k * n + i ]: first size of the last of those classes
+    uint64_t* waste = new uint64_t[ ( size_t )class_count * n ];
+    uint32_t* first = new uint32_t[ ( size_t )class_count * n ];
+    for( uint32_t i = 0; i < n; i++ ) {
+        waste[ i ] = size_array[ i ] * peak_sum[ i + 1 ] - bytes_sum[ i + 1 ];
+        first[ i ] = 0;
+    }
+    for( uint32_t k = 1; k < class_count; k++ ) {
+        for( uint32_t i = 0; i < n; i++ ) {
+            uint64_t best = waste[ ( k - 1 ) * n + i ];
+            uint32_t best_first = first[ ( k - 1 ) * n + i ];
+            for( uint32_t j = 1; j <= i; j++ ) {
+                uint64_t cost = waste[ ( k - 1 ) * n + j - 1 ] +
+                    size_array[ i ] * ( peak_sum[ i + 1 ] - peak_sum[ j ] ) -
+                    ( bytes_sum[ i + 1 ] - bytes_sum[ j ] );
+                if( cost < best ) {
+                    best = cost;
+                    best_first = j;
+                }
+            }
+            waste[ k * n + i ] = best;
+            first[ k * n + i ] = best_first;
+        }
+    }
+
+    // Walk the classes back from the largest size
+    uint16_t count = 0;
+    int32_t k = class_count - 1;
+    int64_t last = ( int64_t )n - 1;
+    while( last >= 0 ) {
+        // Fewer classes may cover sizes 0..last just as well
+        while( k > 0 && waste[ ( k - 1 ) * n + last ] == waste[ k * n + last ] ) {
+            k--;
+        }
+        uint32_t j = first[ k * n + last ];
+        spec_array[ count ].block_size = size_array[ last ];
+        uint64_t blocks = ( peak_sum[ last + 1 ] - peak_sum[ j ] ) *
+            ( 100 + headroom_percent ) / 100;
+        spec_array[ count ].block_count = blocks > 0 ? ( uint32_t )blocks : 1;
+        count++;
+        last = ( int64_t )j - 1;
+        k--;
+    }
+    // Increasing block size order
+    for( uint16_t i = 0; i < count / 2; i++ ) {
+        MemPoolSpecStr tmp = spec_array[ i ];
+        spec_array[ i ] = spec_array[ count - 1 - i ];
+        spec_array[ count - 1 - i ] = tmp;
+    }
+
+    delete[] size_array;
+    delete[] peak_array;
+    delete[] peak_sum;
+    delete[] bytes_sum;
+    delete[] waste;
+    delete[] first;
+    return count;
+}
+
+bool MemPoolManager::writePoolConfig( const char* path, uint16_t max_pools,
+    uint32_t headroom_percent ) {
+    MemPoolSpecStr* spec_array = new MemPoolSpecStr[ max_pools ];
+    uint16_t count = recommendPools( spec_array, max_pools, headroom_percent );
+    FILE* fp = fopen( path, "w" );
+    if( fp != NULL ) {
+        fprintf( fp, "# Testocore memory pool configuration\n" );
+        fprintf( fp, "# block_size block_count\n" );
+        for( uint16_t i = 0; i < count; i++ ) {
+            fprintf( fp, "%u %u\n", spec_array[ i ].block_size,
+                spec_array[ i ].block_count );
+        }
+        fclose( fp );
+    }
+    delete[] spec_array;
+    return fp != NULL;
+}
+
+/**
+ * Reads "block_size block_count" lines; empty lines and lines starting
+ * with '#' are skipped.
+ */
+bool MemPoolManager::addPoolsFromConfig( const char* path,
+    const MemPoolConfigStr& config ) {
+    FILE* fp = fopen( path, "r" );
+    if( fp == NULL ) {
+        return false;
+    }
+    bool ok = true;
+    char line[ 128 ];
+    while( ok && fgets( line, sizeof( line ), fp ) != NULL ) {
+        unsigned int block_size = 0;
+        unsigned int block_count = 0;
+        if( line[ 0 ] == '#' || line[ 0 ] == '\n' || line[ 0 ] == '\r' ) {
+            continue;
+        }
+        if( sscanf( line, "%u %u", &block_size, &block_count ) != 2 ||
+            block_size < sizeof( void* ) || block_count == 0 ) {
+            ok = false;
+            break;
+        }
+        MemPoolConfigStr pool_config = config;
+        pool_config.layout = m_Layout;
+        MemoryPool* pool_ptr = new MemoryPool( block_size, block_count, pool_config );
+        if( !addPool( pool_ptr ) ) {
+            delete pool_ptr;
+            ok = false;
+        }
+    }
+    fclose( fp );
+    return ok;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Telemetry of MemPoolManager */
+/*----------------------------------------------------------------------------*/
+
+void MemPoolManager::createTags( void ) {
+    m_pTags = new MemPoolTagEntryStr[ kMaxTagCount ];
+    for( uint32_t i = 0; i < kMaxTagCount; i++ ) {
+        m_pTags[ i ].name = NULL;
+        m_pTags[ i ].budget_bytes = 0;
+        m_pTags[ i ].live_blocks = 0;
+        m_pTags[ i ].live_bytes = 0;
+        m_pTags[ i ].peak_bytes = 0;
+        m_pTags[ i ].over_budget_allocs = 0;
+    }
+}
+
+bool MemPoolManager::setTelemetry( bool enable ) {
+    if( enable && m_Layout != MemPoolConfigStr::LAYOUT_HEADER ) {
+        return false;
+    }
+    if( enable ) {
+        if( m_pTags == NULL ) {
+            createTags();
+        }
+        // The live counts stay: blocks of an earlier session are still
+        // released from them when freed (see m_TelemetryCounted)
+        for( uint32_t i = 0; i < kMaxTagCount; i++ ) {
+            m_pTags[ i ].over_budget_allocs = 0;
+        }
+        m_RequestedBytes = 0;
+        m_WastedBytes = 0;
+        resetPeaks();
+        m_TelemetryCounted = true;
+    }
+    m_Telemetry = enable;
+    return true;
+}
+
+// Raises 'peak' to 'value' if it is lower
+template< class T >
+static void raisePeak( std::atomic< T >& peak, T value ) {
+    T old_peak = peak.load( std::memory_order_relaxed );
+    while( value > old_peak &&
+           !peak.compare_exchange_weak( old_peak, value, std::memory_order_relaxed ) ) {
+    }
+}
+
+/**
+ * Charges the block to the manager and to its tag, and marks the block
+ * as counted so that freeing it later undoes exactly this.
+ */
+void MemPoolManager::recordTelemetryAlloc( void* ptr, uint32_t bytes, uint8_t tag ) {
+    MemBlockStr* block_ptr = ( MemBlockStr* )( ( uint8_t* )ptr - SIZE_MEM_BLOCK_HEADER );
+    block_ptr->header = ( block_ptr->header & 0xBFFF00FF ) |
+        ( ( uint32_t )tag << 8 ) | ( 1 << 30 );
+    uint64_t block_bytes = getPool( block_ptr->header & 0xFF )->getBlockSize();
+
+    raisePeak( m_PeakBlocks, m_LiveBlocks.fetch_add( 1, std::memory_order_relaxed ) + 1 );
+    raisePeak( m_PeakBytes, m_LiveBytes.fetch_add( block_bytes, std::memory_order_relaxed ) + block_bytes );
+    m_RequestedBytes.fetch_add( bytes, std::memory_order_relaxed );
+    m_WastedBytes.fetch_add( block_bytes - bytes, std::memory_order_relaxed );
+
+    MemPoolTagEntryStr* tag_ptr = &m_pTags[ tag ];
+    tag_ptr->live_blocks.fetch_add( 1, std::memory_order_relaxed );
+    uint64_t live = tag_ptr->live_bytes.fetch_add( block_bytes, std::memory_order_relaxed ) + block_bytes;
+    raisePeak( tag_ptr->peak_bytes, live );
+    if( tag_ptr->budget_bytes > 0 && live > tag_ptr->budget_bytes ) {
+        tag_ptr->over_budget_allocs.fetch_add( 1, std::memory_order_relaxed );
+    }
+}
+
+/**
+ * Releases the charge of a counted block. Blocks allocated while
+ * telemetry was off carry no flag and are skipped. Called even after
+ * telemetry is disabled, so that no flag outlives its charge.
+ */
+void MemPoolManager::recordTelemetryDealloc( void* ptr ) {
+    MemBlockStr* block_ptr = ( MemBlockStr* )( ( uint8_t* )ptr - SIZE_MEM_BLOCK_HEADER );
+    uint32_t header = block_ptr->header;
+    if( ( header & ( 1 << 30 ) ) == 0 ) {
+        return;
+    }
+    block_ptr->header = header & 0xBFFF00FF;
+    uint64_t block_bytes = getPool( header & 0xFF )->getBlockSize();
+    m_LiveBlocks.fetch_sub( 1, std::memory_order_relaxed );
+    m_LiveBytes.fetch_sub( block_bytes, std::memory_order_relaxed );
+    MemPoolTagEntryStr* tag_ptr = &m_pTags[ ( header >> 8 ) & 0xFF ];
+    tag_ptr->live_blocks.fetch_sub( 1, std::memory_order_relaxed );
+    tag_ptr->live_bytes.fetch_sub( block_bytes, std::memory_order_relaxed );
+}
+
+void MemPoolManager::setTagName( uint8_t tag, const char* name ) {
+    if( m_pTags == NULL ) {
+        createTags();
+    }
+    m_pTags[ tag ].name = name;
+}
+
+void MemPoolManager::setTagBudget( uint8_t tag, uint64_t bytes ) {
+    if( m_pTags == NULL ) {
+        createTags();
+    }
+    m_pTags[ tag ].budget_bytes = bytes;
+}
+
+void MemPoolManager::getStats( MemPoolStatsStr& stats ) {
+    stats.live_blocks = m_LiveBlocks.load( std::memory_order_relaxed );
+    stats.peak_blocks = m_PeakBlocks.load( std::memory_order_relaxed );
+    stats.live_bytes = m_LiveBytes.load( std::memory_order_relaxed );
+    stats.peak_bytes = m_PeakBytes.load( std::memory_order_relaxed );
+    stats.failed_allocs = m_FailedAllocs.load( std::memory_order_relaxed );
+    stats.fallthroughs = m_Fallthroughs.load( std::memory_order_relaxed );
+    stats.requested_bytes = m_RequestedBytes.load( std::memory_order_relaxed );
+    stats.wasted_bytes = m_WastedBytes.load( std::memory_order_relaxed );
+}
+
+void MemPoolManager::getTagStats( uint8_t tag, MemPoolTagStatsStr& stats ) {
+    memset( &stats, 0, sizeof( stats ) );
+    if( m_pTags == NULL ) {
+        return;
+    }
+    MemPoolTagEntryStr* tag_ptr = &m_pTags[ tag ];
+    stats.name = tag_ptr->name;
+    stats.live_blocks = tag_ptr->live_blocks.load( std::memory_order_relaxed );
+    stats.live_bytes = tag_ptr->live_bytes.load( std::memory_order_relaxed );
+    stats.peak_bytes = tag_ptr->peak_bytes.load( std::memory_order_relaxed );
+    stats.budget_bytes = tag_ptr->budget_bytes;
+    stats.over_budget_allocs = tag_ptr->over_budget_allocs.load( std::memory_order_relaxed );
+}
+
+void MemPoolManager::resetPeaks( void ) {
+    m_PeakBlocks = m_LiveBlocks.load();
+    m_PeakBytes = m_LiveBytes.load();
+    if( m_pTags != NULL ) {
+        for( uint32_t i = 0; i < kMaxTagCount; i++ ) {
+            m_pTags[ i ].peak_bytes = m_pTags[ i ].live_bytes.load();
+        }
+    }
+}
+
+void MemPoolManager::logStats( FILE* fp ) {
+    MemPoolStatsStr stats;
+    getStats( stats );
+    fprintf( fp, "pools: %u blocks (peak %u), %llu bytes (peak %llu), "
+        "%u failed, %u fall-throughs, %llu of %llu bytes wasted\n",
+        stats.live_blocks, stats.peak_blocks,
+        ( unsigned long long )stats.live_bytes, ( unsigned long long )stats.peak_bytes,
+        stats.failed_allocs, stats.fallthroughs,
+        ( unsigned long long )stats.wasted_bytes,
+        ( unsigned long long )( stats.requested_bytes + stats.wasted_bytes ) );
+    for( uint32_t i = 0; i < kMaxTagCount && m_pTags != NULL; i++ ) {
+        MemPoolTagStatsStr tag_stats;
+        getTagStats( ( uint8_t )i, tag_stats );
+        if( tag_stats.name == NULL && tag_stats.peak_bytes == 0 ) {
+            continue;
+        }
+        fprintf( fp, "  tag %u %s: %u blocks, %llu bytes (peak %llu, budget %llu)%s\n",
+            i, tag_stats.name != NULL ? tag_stats.name : "-", tag_stats.live_blocks,
+            ( unsigned long long )tag_stats.live_bytes,
+            ( unsigned long long )tag_stats.peak_bytes,
+            ( unsigned long long )tag_stats.budget_bytes,
+            tag_stats.over_budget_allocs > 0 ? " OVER BUDGET" : "" );
+    }
+}
+
+/*----------------------------------------------------------------------------*/
+/* Thread cache handling of MemPoolManager */
+/*----------------------------------------------------------------------------*/
+
+namespace {
+// Caches live in malloc'd memory. With pool_new.o linked in, operator
+// new/delete are served through a thread cache themselves and would
+// re-enter getThreadCache() while a cache is being created or destroyed.
+ThreadCache* createThreadCache( MemPoolManager* manager_ptr ) {
+    void* ptr = malloc( sizeof( ThreadCache ) );
+    if( ptr == NULL ) {
+        throw std::bad_alloc();
+    }
+    return new( ptr ) ThreadCache( manager_ptr );
+}
+
+void destroyThreadCache( ThreadCache* cache_ptr ) {
+    if( cache_ptr != NULL ) {
+        cache_ptr->~ThreadCache();
+        free( cache_ptr );
+    }
+}
+
+// Owns the caches of the current thread, one per cache slot, and
+// flushes them on thread exit.
+struct ThreadCacheHolderStr {
+    ThreadCache* pCaches[ MemPoolManager::kThreadCacheSlots ];
+    // Each pointer is cleared first so that a deallocation made during
+    // the flush or later during thread exit (e.g. by a global operator
+    // delete) starts a new cache instead of using the deleted one.
+    ~ThreadCacheHolderStr() {
+        for( uint32_t i = 0; i < MemPoolManager::kThreadCacheSlots; i++ ) {
+            ThreadCache* cache_ptr = pCaches[ i ];
+            pCaches[ i ] = NULL;
+            destroyThreadCache( cache_ptr );
+        }
+    }
+};
+thread_local ThreadCacheHolderStr t_CacheHolder = { { NULL } };
+
+// Number of live managers using each cache slot
+std::mutex s_CacheSlotLock;
+uint32_t s_CacheSlotUsers[ MemPoolManager::kThreadCacheSlots ] = { 0 };
+}
+
+uint32_t MemPoolManager::acquireCacheSlot( void ) {
+    std::lock_guard< std::mutex > guard( s_CacheSlotLock );
+    uint32_t slot = 0;
+    for( uint32_t i = 1; i < kThreadCacheSlots; i++ ) {
+        if( s_CacheSlotUsers[ i ] < s_CacheSlotUsers[ slot ] ) {
+            slot = i;
+        }
+    }
+    s_CacheSlotUsers[ slot ]++;
+    return slot;
+}
+
+void MemPoolManager::releaseCacheSlot( uint32_t slot ) {
+    std::lock_guard< std::mutex > guard( s_CacheSlotLock );
+    s_CacheSlotUsers[ slot ]--;
+}
+
+/**
+ * Returns the calling thread's cache for this manager, creating it on
+ * first use. The cache lives in the manager's cache slot, so a thread
+ * keeps the caches of several managers at once. A cache left in the slot
+ * by a destroyed manager, or by another manager sharing the slot, is
+ * flushed and replaced.
+ */
+ThreadCache* MemPoolManager::getThreadCache( void ) {
+    ThreadCache** slot_ptr = &t_CacheHolder.pCaches[ m_CacheSlot ];
+    ThreadCache* cache_ptr = *slot_ptr;
+    if( cache_ptr != NULL && cache_ptr->m_pManager == this ) {
+        return cache_ptr;
+    }
+    // The slot is empty while the old cache is flushed, so nothing can
+    // reach the cache being destroyed.
+    *slot_ptr = NULL;
+    destroyThreadCache( cache_ptr );
+    cache_ptr = createThreadCache( this );
+    *slot_ptr = cache_ptr;
+    return cache_ptr;
+}
+
+void MemPoolManager::registerCache( ThreadCache* cache_ptr ) {
+    std::lock_guard< std::mutex > guard( m_CacheListLock );
+    cache_ptr->m_pPrev = NULL;
+    cache_ptr->m_pNext = m_pCacheList;
+    if( m_pCacheList != NULL ) {
+        m_pCacheList->m_pPrev = cache_ptr;
+    }
+    m_pCacheList = cache_ptr;
+}
+
+void MemPoolManager::unregisterCache( ThreadCache* cache_ptr ) {
+    std::lock_guard< std::mutex > guard( m_CacheListLock );
+    if( cache_ptr->m_pPrev != NULL ) {
+        cache_ptr->m_pPrev->m_pNext = cache_ptr->m_pNext;
+    }
+    else {
+        m_pCacheList = cache_ptr->m_pNext;
+    }
+    if( cache_ptr->m_pNext != NULL ) {
+        cache_ptr->m_pNext->m_pPrev = cache_ptr->m_pPrev;
+    }
+}
+
+/*----------------------------------------------------------------------------*/
+/* class ThreadCache see mem_pool.h */
+/*----------------------------------------------------------------------------*/
+
+ThreadCache::ThreadCache( MemPoolManager* manager_ptr ) :
+    m_pManager( manager_ptr ), m_pMagazines( NULL ), m_MagazineCount( 0 ),
+    m_pNext( NULL ), m_pPrev( NULL ) {
+
+    // Magazines are malloc'd for the same reason as the cache itself
+    if( manager_ptr->m_SizeClassCount > 0 ) {
+        m_pMagazines = ( MagazineStr* )malloc(
+            manager_ptr->m_SizeClassCount * sizeof( MagazineStr ) );
+    }
+    if( m_pMagazines != NULL ) {
+        m_MagazineCount = manager_ptr->m_SizeClassCount;
+    }
+    // Magazines follow the order of the size classes
+    for( uint16_t i = 0; i < m_MagazineCount; i++ ) {
+        m_pMagazines[ i ].pPool = manager_ptr->m_pSizeClasses[ i ];
+        m_pMagazines[ i ].count = 0;
+    }
+    manager_ptr->registerCache( this );
+}
+
+ThreadCache::~ThreadCache() {
+    if( m_pManager != NULL ) {
+        flushAll();
+        m_pManager->unregisterCache( this );
+    }
+    free( m_pMagazines );
+}
+
+/**
+ * Fills the magazine with blocks from its pool while holding the pool lock.
+ */
+bool ThreadCache::refill( MagazineStr* mag_ptr ) {
+    MemoryPool* pool_ptr = mag_ptr->pPool;
+    std::lock_guard< std::mutex > guard( pool_ptr->getLock() );
+    mag_ptr->count += pool_ptr->allocBatch( mag_ptr->blocks + mag_ptr->count,
+        kMagazineSize - mag_ptr->count );
+    return mag_ptr->count > 0;
+}
+
+/**
+ * Returns the bottom half of a full magazine to the pool. The most recently
+ * freed blocks stay in the magazine as they are most likely still in cache.
+ */
+void ThreadCache::flush( MagazineStr* mag_ptr ) {
+    uint32_t count = mag_ptr->count < kMagazineSize ?
+        mag_ptr->count : kMagazineSize;
+    {
+        MemoryPool* pool_ptr = mag_ptr->pPool;
+        std::lock_guard< std::mutex > guard( pool_ptr->getLock() );
+        pool_ptr->deallocBatch( mag_ptr->blocks, count );
+    }
+    mag_ptr->count -= count;
+    memmove( mag_ptr->blocks, mag_ptr->blocks + count,
+        mag_ptr->count * sizeof( void* ) );
+}
+
+/**
+ * Returns all cached blocks back to their pools.
+ */
+void ThreadCache::flushAll( void ) {
+    for( uint16_t i = 0; i < m_MagazineCount; i++ ) {
+        while( m_pMagazines[ i ].count > 0 ) {
+            flush( &m_pMagazines[ i ] );
+        }
+    }
+}
+
+/**
+ * Allocates from the magazine of the size class chosen by the manager.
+ * Like MemPoolManager::alloc, falls through to larger pools when a pool
+ * is full.
+ */
+void* ThreadCache::alloc( uint32_t bytes ) {
+    uint16_t first = m_pManager->findSizeClass( bytes );
+    for( uint16_t i = first; i < m_MagazineCount; i++ ) {
+        MagazineStr* mag_ptr = &m_pMagazines[ i ];
+        if( mag_ptr->count > 0 || refill( mag_ptr ) ) {
+            if( i != first ) {
+                m_pManager->m_Fallthroughs.fetch_add( 1, std::memory_order_relaxed );
+            }
+            return mag_ptr->blocks[ --mag_ptr->count ];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Puts the block into the magazine of the pool owning the block.
+ * The pool id maps to the magazine through the manager's tables.
+ * Blocks of a pool added after this cache was created have no magazine
+ * and go straight back to their pool.
+ */
+void ThreadCache::dealloc( void* ptr ) {
+    MemoryPool* pool_ptr = m_pManager->getBlockPool( ptr );
+    if( pool_ptr == NULL ) {
+        return; // Not a block of the manager's pools
+    }
+    uint16_t index = m_pManager->m_PoolSizeClass[ pool_ptr->getPoolId() ];
+    if( index >= m_MagazineCount || m_pMagazines[ index ].pPool != pool_ptr ) {
+        std::lock_guard< std::mutex > guard( pool_ptr->getLock() );
+        pool_ptr->dealloc( ptr );
+        return;
+    }
+    MagazineStr* mag_ptr = &m_pMagazines[ index ];
+    if( mag_ptr->count == 2 * kMagazineSize ) {
+        flush( mag_ptr );
+    }
+    mag_ptr->blocks[ mag_ptr->count++ ] = ptr;
 }
@@ -21,6 +21,17 @@
 #ifndef MEM_POOL_H
 #define MEM_POOL_H
 
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <new>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
 /**
  * Structure for a memory block.
  *
@@ -37,35 +48,797 @@ struct MemBlockStr {
     uint32_t header;
     void* pData;
     };
-#define SIZE_MEM_BLOCK_HEADER sizeof( uint32_t )
+// Offset of the payload from the start of the block. Equals sizeof( uint32_t )
+// on 32-bit targets but includes the padding in front of pData on 64-bit ones.
+#define SIZE_MEM_BLOCK_HEADER offsetof( MemBlockStr, pData )
+
+/**
+ * Optional settings for a MemoryPool. The defaults give a pool of one
+ * fixed chunk that never grows, with a header in front of every block.
+ */
+struct MemPoolConfigStr {
+    enum LayoutEnum {
+        // Every block starts with a header holding the pool id. The
+        // first payload of a chunk is 16 byte aligned, so all payloads are
+        // when the block stride is a multiple of 16.
+        LAYOUT_HEADER,
+        // No block header. Blocks start at multiples of 'alignment' and
+        // the owning pool is found from the header of the chunk the block
+        // lives in, by masking the block address with the chunk size.
+        LAYOUT_ALIGNED };
+    enum BackingEnum {
+        // Chunks come from malloc (or an aligned malloc)
+        BACKING_MALLOC,
+        // Chunks are mapped with mmap
+        BACKING_MMAP,
+        // Chunks are mapped with explicit huge pages (MAP_HUGETLB) when
+        // the system has them and the chunk is at least kHugePageBytes,
+        // otherwise with mmap and transparent huge pages requested via
+        // madvise( MADV_HUGEPAGE )
+        BACKING_HUGE_PAGES };
+
+    enum GrowthEnum {
+        // alloc() fails once all blocks of the first chunk are in use
+        GROWTH_NONE,
+        // Adds chunks of growth_blocks blocks
+        GROWTH_FIXED,
+        // Adds chunks as large as the current capacity (doubles it)
+        GROWTH_GEOMETRIC };
+
+    // How the pool grows when it runs out of free blocks
+    GrowthEnum growth;
+    // Blocks per added chunk for GROWTH_FIXED (0 = initial block count)
+    uint32_t growth_blocks;
+    // Upper limit for the total number of blocks (0 = unlimited)
+    uint32_t max_block_count;
+    // Block layout
+    LayoutEnum layout;
+    // Block alignment for LAYOUT_ALIGNED (power of two, at least the
+    // size of a pointer). Block sizes are rounded up to a multiple of it,
+    // so 64 gives cache line sized strides.
+    uint32_t alignment;
+
+    // When the number of blocks in use falls below this percentage of
+    // the pool's capacity (getBlockCount(), which a growing pool keeps
+    // after a peak), the pool trims itself (see MemoryPool::trim).
+    // 0 disables automatic trimming.
+    uint32_t trim_watermark;
+
+    // Where the chunk memory comes from. Platforms without mmap always
+    // use BACKING_MALLOC.
+    BackingEnum backing;
+    // Touch every page of a chunk when it is allocated, so that carving
+    // blocks later never takes a page fault
+    bool prefault;
+
+    MemPoolConfigStr() :
+        growth( GROWTH_NONE ), growth_blocks( 0 ), max_block_count( 0 ),
+        layout( LAYOUT_HEADER ), alignment( 64 ), trim_watermark( 0 ),
+        backing( BACKING_MALLOC ), prefault( false ) {}
+};
+
+/**
+ * Size and count of one pool, as recommended by a profiling
+ * MemPoolManager or read from a pool configuration file.
+ */
+struct MemPoolSpecStr {
+    uint32_t block_size;
+    uint32_t block_count;
+};
+
+/**
+ * Snapshot of the telemetry of a MemPoolManager, see getStats().
+ * Block and byte counts are of pool blocks, including rounding.
+ */
+struct MemPoolStatsStr {
+    uint32_t live_blocks;
+    uint32_t peak_blocks;
+    uint64_t live_bytes;
+    uint64_t peak_bytes;
+    // Requests no pool could serve
+    uint32_t failed_allocs;
+    // Requests served by a larger pool as the best fitting one was full
+    uint32_t fallthroughs;
+    // Sum of requested bytes and of the bytes lost rounding them up to
+    // the block size, over all recorded allocations
+    uint64_t requested_bytes;
+    uint64_t wasted_bytes;
+};
+
+/**
+ * Snapshot of the usage of one allocation tag, see getTagStats().
+ */
+struct MemPoolTagStatsStr {
+    const char* name;
+    uint32_t live_blocks;
+    uint64_t live_bytes;
+    uint64_t peak_bytes;
+    // Budget in bytes, 0 if none is set
+    uint64_t budget_bytes;
+    // Allocations that took the live bytes of the tag over its budget
+    uint32_t over_budget_allocs;
+};
+
+class MemoryPool;
+
+/**
+ * Header in front of every chunk of a MemoryPool. The blocks of the chunk
+ * follow the header.
+ */
+struct MemChunkStr {
+    MemChunkStr* pNext;
+    // Pool owning the chunk
+    MemoryPool* pPool;
+    // Size of the mapping for mmap backed chunks, 0 for malloc'd ones
+    size_t map_bytes;
+    uint32_t block_count;
+    // Number of free blocks, only valid during MemoryPool::trim()
+    uint32_t free_count;
+};
 
 /**
  * Simple and fast memory pool with fixed size blocks.
- * Uses malloc to allocate one chunk of memory which is then divided into
- * smaller blocks to be used by the client.
+ * Uses malloc to allocate chunks of memory which are then divided into
+ * smaller blocks to be used by the client. The first chunk holds the
+ * block count given to the constructor; more chunks are added on demand
+ * if the pool is configured to grow.
+ *
+ * Blocks of a new chunk are not linked into the free list up front.
+ * They are carved one by one from the never used end of the newest chunk
+ * (bump pointer), and the free list only holds blocks that have been
+ * deallocated. Creating a pool therefore does not touch its memory, and
+ * pages are only faulted in once blocks on them are handed out.
+ *
+ * With MemPoolConfigStr::LAYOUT_ALIGNED the pool is split into chunks of
+ * kAlignedChunkBytes, each aligned to its own size. Blocks carry no
+ * header and getChunkPool() finds the pool of any block by masking its
+ * address. Chunks are allocated one at a time as blocks are carved.
+ *
+ * MemPoolConfigStr::backing selects where chunks come from: malloc,
+ * plain mmap, or huge pages for large pools that suffer from TLB misses.
+ * With 'prefault' set, chunks are faulted in when they are allocated.
+ *
+ * A pool bound to an owner thread with setOwnerThread() may be freed into
+ * from other threads: dealloc() called by another thread pushes the block
+ * onto a lock-free remote free queue with a single atomic operation, and
+ * the owner moves the queued blocks to its free list in one batch once
+ * its free list runs empty. All other methods belong to the owner.
  */
 class MemoryPool {
+public:
+    // Size and alignment of the chunks of LAYOUT_ALIGNED pools
+    static const uint32_t kAlignedChunkBytes = 256 * 1024;
+    // Size of an explicit huge page (BACKING_HUGE_PAGES)
+    static const uint32_t kHugePageBytes = 2 * 1024 * 1024;
+
 private:
-    // Pointer to pool's address space (the address returned by malloc)
+    // Pointer to pool's address space (the first block of the first chunk)
     void*               m_pPool;
-    // Pointer to next free memory block in the pool
-    MemBlockStr*        m_pFreeMemBlock;
+    // Chunks of the pool, most recently added first
+    MemChunkStr*        m_pChunks;
+    // The same chunks sorted by address for finding the chunk of a block,
+    // and the allocated length of the table
+    MemChunkStr**       m_pChunkTable;
+    uint32_t            m_ChunkTableLen;
+    // Start of the next free memory block in the pool
+    uint8_t*            m_pFreeMemBlock;
+    // Never used region of the newest chunk: next block to carve and the
+    // end of the chunk
+    uint8_t*            m_pBumpPtr;
+    uint8_t*            m_pBumpEnd;
+    // Distance between two consecutive blocks (header + block size)
+    uint32_t            m_BlockStride;
+    // Size of the block header, 0 for LAYOUT_ALIGNED
+    uint32_t            m_HeaderSize;
     // Size of one memory block (in bytes)
     uint32_t            m_BlockSize;
-    // Number of memory block in the pool
+    // Number of memory blocks in the pool, including those of chunks
+    // not allocated yet
     uint32_t            m_BlockCount;
+    // Blocks of the capacity which have no chunk yet
+    uint32_t            m_UncommittedBlocks;
+    // Set when the memory for a chunk could not be allocated, cleared
+    // when a chunk is added or the pool is trimmed
+    bool                m_ChunkAllocFailed;
+    // Number of chunks in the pool
+    uint32_t            m_ChunkCount;
+    // Number of blocks handed out and not deallocated, the highest value
+    // since creation or resetPeak(), and allocations that found no block
+    uint32_t            m_UsedBlocks;
+    uint32_t            m_PeakUsedBlocks;
+    uint32_t            m_FailedAllocs;
+    // Automatic trimming: usage below m_TrimLevel trims the pool if the
+    // usage has been above it since the last trim
+    uint32_t            m_TrimLevel;
+    bool                m_TrimArmed;
+    // Growth policy and layout
+    MemPoolConfigStr    m_Config;
     // Pool's id for distinguishing multiple pools
     uint16_t            m_PoolId;
+    // Thread allowed to use the free list directly, default id if unbound
+    std::thread::id     m_Owner;
+    // Blocks freed by other threads than the owner, linked like the free
+    // list. Pushed by any thread, detached as a whole by the owner.
+    std::atomic< uint8_t* > m_RemoteFree;
+    // Guards the free list when the pool is shared between thread caches.
+    // Plain alloc() and dealloc() never take the lock.
+    std::mutex          m_Lock;
 
     // Disable copy constructor
     MemoryPool( const MemoryPool& copy );
 
+    // Returns the free list link stored in a free block
+    void** getLink( uint8_t* block_ptr ) {
+        return ( void** )( block_ptr + m_HeaderSize );
+    }
+    // Allocates a chunk for (some of) the uncommitted blocks and makes it
+    // the never used region
+    MemChunkStr* addChunk( void );
+    // Offset of the first block from the start of a chunk
+    uint32_t getChunkOffset( void );
+    // Recalculates m_TrimLevel after the capacity has changed
+    void updateTrimLevel( void );
+    // Returns the chunk holding the block, NULL if none does
+    MemChunkStr* findChunk( uint8_t* block_ptr );
+    // Frees the chunks trim() has marked for release and returns the
+    // number of bytes released
+    size_t releaseChunks( void );
+    // Releases the pages of the never used region of the newest chunk
+    size_t purgeBumpRegion( void );
+    // Gets memory for a chunk from the configured backing store and
+    // releases it again
+    MemChunkStr* allocChunkMemory( size_t bytes, size_t alignment );
+    void freeChunkMemory( MemChunkStr* chunk_ptr );
+    // Returns the number of blocks the pool would grow by, 0 if the
+    // pool may not grow anymore
+    uint32_t getGrowthBlockCount( void );
+    // Makes the never used region non-empty by committing uncommitted
+    // blocks or growing the pool. Returns false if the pool is full.
+    bool refillBumpRegion( void );
+
 public:
     // Allocates memory and initializes the blocks.
-    explicit MemoryPool( uint32_t block_size, uint32_t block_count );
+    explicit MemoryPool( uint32_t block_size, uint32_t block_count,
+        const MemPoolConfigStr& config = MemPoolConfigStr() );
     // Destructor frees the allocated memory.
     ~MemoryPool( void );
 
+    // Getters and setters:
+    void* getPoolPtr( void ) { return m_pPool; }
+    uint32_t getBlockSize( void ) { return m_BlockSize; }
+    uint32_t getBlockStride( void ) { return m_BlockStride; }
+    uint32_t getBlockCount( void ) { return m_BlockCount; }
+    uint32_t getChunkCount( void ) { return m_ChunkCount; }
+    uint32_t getUsedBlockCount( void ) { return m_UsedBlocks; }
+    uint32_t getPeakUsedBlockCount( void ) { return m_PeakUsedBlocks; }
+    uint32_t getFailedAllocCount( void ) { return m_FailedAllocs; }
+    void resetPeak( void ) { m_PeakUsedBlocks = m_UsedBlocks; }
+    MemPoolConfigStr::LayoutEnum getLayout( void ) { return m_Config.layout; }
+    uint16_t getPoolId( void ) { return m_PoolId; }
+    void setPoolId( uint16_t id ) { m_PoolId = id; }
+    std::mutex& getLock( void ) { return m_Lock; }
+    // Binds the pool to the calling thread. Deallocations made by other
+    // threads go through the remote free queue from then on.
+    void setOwnerThread( void ) { m_Owner = std::this_thread::get_id(); }
+    std::thread::id getOwnerThread( void ) { return m_Owner; }
+    // Returns true if the next alloc() would fail. After the memory for a
+    // chunk could not be allocated, a pool without free blocks counts as
+    // exhausted until a chunk is added again or the pool is trimmed.
+    bool isExhausted( void ) {
+        return m_pFreeMemBlock == NULL && m_pBumpPtr == m_pBumpEnd &&
+            ( m_ChunkAllocFailed ||
+              ( m_UncommittedBlocks == 0 && getGrowthBlockCount() == 0 ) ) &&
+            m_RemoteFree.load( std::memory_order_relaxed ) == NULL;
+    }
+
+    // Returns the pool owning a block of a LAYOUT_ALIGNED pool
+    static MemoryPool* getChunkPool( void* ptr ) {
+        return ( ( MemChunkStr* )( ( uintptr_t )ptr &
+            ~( uintptr_t )( kAlignedChunkBytes - 1 ) ) )->pPool;
+    }
+
+    // Returns one free block from the pool, adding a chunk first if the
+    // pool is full and allowed to grow. If no free blocks, returns NULL.
+    void* alloc( void );
+    // Sets the given block back into the pool as a free block. Called
+    // by another thread than the owner, queues the block as a remote free.
+    void dealloc( void* ptr ) {
+        if( m_Owner != std::thread::id() &&
+            m_Owner != std::this_thread::get_id() ) {
+            deallocRemote( ptr );
+        }
+        else {
+            deallocLocal( ptr );
+        }
+    }
+    // Frees a block into the free list. Only for the owner thread.
+    void deallocLocal( void* ptr );
+    // Queues a block freed by any thread. The owner reuses it after the
+    // next drainRemoteFrees(), which alloc() does when the free list is
+    // empty.
+    void deallocRemote( void* ptr );
+    // Moves the queued remote frees to the free list and returns how many
+    // blocks were moved. Only for the owner thread.
+    uint32_t drainRemoteFrees( void );
+    // Allocates up to 'count' blocks into ptr_array and returns how many
+    // were allocated. Detaches a whole segment of the free list and carves
+    // the rest from the never used region.
+    uint32_t allocBatch( void** ptr_array, uint32_t count );
+    // Frees 'count' blocks of this pool by linking them together and
+    // splicing the chain onto the free list in one step.
+    void deallocBatch( void** ptr_array, uint32_t count );
+    // Returns the number of free memory blocks in the pool, including
+    // the blocks not carved yet. Blocks waiting in the remote free queue
+    // count as used until they are drained.
+    uint32_t getFreeBlockCount( void ) { return m_BlockCount - m_UsedBlocks; }
+    // Returns idle memory to the system. Chunks whose blocks are all free
+    // are released, except the first chunk; their blocks become
+    // uncommitted again, so the capacity of the pool does not change.
+    // If no block is in use at all, the first chunk becomes never carved
+    // again. The never carved pages of the newest chunk are released with
+    // madvise. Does not allocate. Returns the number of bytes released.
+    // Only for the owner thread.
+    size_t trim( void );
+};
+
+/**
+ * Fixed capacity pool for very small blocks, down to 4 bytes.
+ * Free blocks are linked by their 32-bit index instead of a pointer and
+ * blocks have no header: the owning pool is found by address range and
+ * the allocation state lives in a bitmap next to the blocks. The stride
+ * is the block size rounded up to 4 bytes, so a pool of 4-byte handles
+ * packs 16 of them into a cache line where a MemoryPool fits 4.
+ *
+ * Like MemoryPool, blocks are carved lazily from the never used end of
+ * the pool and the free list only holds deallocated blocks.
+ *
+ * As no link in the pool is a pointer, the pool can live in a memory
+ * mapped file and be mapped again by the next run without any fixing up.
+ * The file starts with a header holding the pool state, a version given
+ * by the client and a hash of the block layout. If they do not match
+ * when the file is opened, the pool starts empty and the file is
+ * rewritten. Data stored in the blocks must refer to other blocks by
+ * index (getBlockIndex()) for the snapshot to stay valid.
+ *
+ * The blocks reach the file as they are written, but the header only
+ * in sync(). The header is therefore marked clean only by a successful
+ * sync() and dirty again by the first alloc or dealloc after it. A
+ * snapshot left dirty (the process died between two syncs) or with a
+ * pool state out of range is discarded like a mismatching one.
+ */
+class CompactMemoryPool {
+public:
+    // Index stored in the free list head for an empty list
+    static const uint32_t kNullIndex = 0xFFFFFFFF;
+    // Identifies a snapshot file, followed by the file format version
+    static const uint32_t kSnapshotMagic = 0x4C4F4F50;
+    static const uint32_t kSnapshotFormat = 2;
+
+private:
+    // Header at the start of a snapshot file
+    struct SnapshotHeaderStr {
+        uint32_t magic;
+        uint32_t format;
+        uint32_t version;
+        uint32_t block_size;
+        uint32_t block_count;
+        uint32_t free_head;
+        uint32_t bump_index;
+        uint32_t used_blocks;
+        // Non-zero if the header matches the blocks (see sync())
+        uint32_t clean;
+        uint64_t layout_hash;
+    };
+    // Size reserved for the header, keeps the bitmap and blocks aligned
+    static const uint32_t kSnapshotHeaderBytes = 64;
+
+    // Start of the memory holding the bitmap and the blocks, or of the
+    // whole mapping for a file backed pool
+    uint8_t*    m_pMemory;
+    // File backed pools: size of the mapping, the header in it and the
+    // layout hash expected in the header. m_pSnapshot is NULL otherwise.
+    size_t      m_MapBytes;
+    SnapshotHeaderStr* m_pSnapshot;
+    uint64_t    m_LayoutHash;
+    // Whether the contents were restored from an existing snapshot
+    bool        m_Restored;
+    // Pointer to the first block
+    uint8_t*    m_pPool;
+    // One bit per block, set while the block is allocated
+    uint32_t*   m_pAllocBits;
+    // Size of one memory block and the distance between two blocks
+    uint32_t    m_BlockSize;
+    uint32_t    m_BlockStride;
+    // Number of memory blocks in the pool
+    uint32_t    m_BlockCount;
+    // Index of the first free block, kNullIndex if the list is empty
+    uint32_t    m_FreeHead;
+    // Index of the next never used block
+    uint32_t    m_BumpIndex;
+    // Number of blocks handed out and not deallocated
+    uint32_t    m_UsedBlocks;
+    // Pool's id for distinguishing multiple pools
+    uint16_t    m_PoolId;
+
+    // Disable copy constructor
+    CompactMemoryPool( const CompactMemoryPool& copy );
+
+    // Returns the free list link stored in a free block
+    uint32_t* getLink( uint32_t index ) {
+        return ( uint32_t* )( m_pPool + ( size_t )index * m_BlockStride );
+    }
+    // Size of the allocation bitmap, rounded up to keep the blocks aligned
+    uint32_t getBitmapBytes( void ) {
+        return ( ( m_BlockCount + 511 ) / 512 ) * 64;
+    }
+    // Maps the snapshot file and restores the pool from it if the header
+    // matches. Returns false if the file could not be mapped.
+    bool mapSnapshot( const char* file_path, uint32_t version );
+    // Clears the clean flag of the snapshot header and writes the header
+    // to the file before the blocks are changed
+    void markDirty( void );
+    bool isSnapshotClean( void ) { return m_pSnapshot != NULL && m_pSnapshot->clean != 0; }
+
+public:
+    // Allocates memory for the blocks and the allocation bitmap.
+    explicit CompactMemoryPool( uint32_t block_size, uint32_t block_count );
+    // Uses the given file as the backing store. A snapshot saved with the
+    // same version, block size, block count and layout hash is restored;
+    // otherwise the pool starts empty. 'layout_hash' should describe the
+    // type stored in the blocks (see hashLayout()). Falls back to heap
+    // memory if the file can not be mapped.
+    explicit CompactMemoryPool( uint32_t block_size, uint32_t block_count,
+        const char* file_path, uint32_t version, uint64_t layout_hash = 0 );
+    // Destructor frees the memory, or saves and unmaps the snapshot.
+    ~CompactMemoryPool( void );
+
+    // FNV-1a hash for building layout hashes, e.g. over the sizes and
+    // offsets of the fields stored in the blocks. Chain calls by passing
+    // the previous result as 'hash'.
+    static uint64_t hashLayout( const void* data, size_t bytes,
+        uint64_t hash = 14695981039346656037ULL );
+
+    // File backed pools: writes the pool state into the snapshot header,
+    // flushes the mapping to the file and marks the snapshot clean
+    void sync( void );
+    bool isFileBacked( void ) { return m_pSnapshot != NULL; }
+    bool isRestored( void ) { return m_Restored; }
+
+    // Getters and setters:
+    void* getPoolPtr( void ) { return m_pPool; }
+    uint32_t getBlockSize( void ) { return m_BlockSize; }
+    uint32_t getBlockStride( void ) { return m_BlockStride; }
+    uint32_t getBlockCount( void ) { return m_BlockCount; }
+    uint32_t getUsedBlockCount( void ) { return m_UsedBlocks; }
+    uint32_t getFreeBlockCount( void ) { return m_BlockCount - m_UsedBlocks; }
+    uint16_t getPoolId( void ) { return m_PoolId; }
+    void setPoolId( uint16_t id ) { m_PoolId = id; }
+
+    // Returns true if the block lies within this pool
+    bool contains( void* ptr ) {
+        return ( uint8_t* )ptr >= m_pPool &&
+            ( uint8_t* )ptr < m_pPool + ( size_t )m_BlockCount * m_BlockStride;
+    }
+    // Conversions between a block and its index, e.g. for 32-bit handles
+    uint32_t getBlockIndex( void* ptr ) {
+        return ( uint32_t )( ( ( uint8_t* )ptr - m_pPool ) / m_BlockStride );
+    }
+    void* getBlock( uint32_t index ) {
+        return m_pPool + ( size_t )index * m_BlockStride;
+    }
+    // Returns true if the block of this pool is currently allocated
+    bool isAllocated( void* ptr ) {
+        uint32_t index = getBlockIndex( ptr );
+        return ( m_pAllocBits[ index >> 5 ] >> ( index & 31 ) & 1 ) != 0;
+    }
+
+    // Returns one free block from the pool. If no free blocks, returns NULL.
+    void* alloc( void );
+    // Sets the given block back into the pool as a free block.
+    void dealloc( void* ptr );
+};
+
+/**
+ * Linear allocator for data that lives for one frame.
+ * alloc() bumps an offset in a preallocated buffer and reset() frees
+ * everything at once, so individual allocations are never freed.
+ * Destructors of objects placed in the arena are not run.
+ *
+ * A double buffered arena owns two buffers. swap() ends the frame: it
+ * makes the other buffer current and resets it, while the data written
+ * during the previous frame stays valid until the next swap(). This lets
+ * the render thread read frame N while frame N+1 is being built.
+ */
+class FrameArena {
+private:
+    // The buffers, the second one is NULL for a single buffered arena
+    uint8_t*    m_pBuffers[ 2 ];
+    // Size of one buffer (in bytes)
+    uint32_t    m_Capacity;
+    // Index of the buffer allocations come from
+    uint32_t    m_Current;
+    // Offset of the first unused byte in the current buffer
+    uint32_t    m_Offset;
+    // Highest usage of the frames ended so far
+    uint32_t    m_PeakUsage;
+
+    // Disable copy constructor
+    FrameArena( const FrameArena& copy );
+
+public:
+    // Allocates the buffer(s) of 'capacity' bytes.
+    explicit FrameArena( uint32_t capacity, bool double_buffered = false );
+    // Destructor frees the buffers.
+    ~FrameArena( void );
+
+    // Getters:
+    uint32_t getCapacity( void ) { return m_Capacity; }
+    uint32_t getUsedBytes( void ) { return m_Offset; }
+    // Highest number of bytes used in one frame, for sizing the arena
+    uint32_t getPeakUsage( void ) {
+        return m_Offset > m_PeakUsage ? m_Offset : m_PeakUsage;
+    }
+    bool isDoubleBuffered( void ) { return m_pBuffers[ 1 ] != NULL; }
+
+    // Returns 'bytes' of memory aligned to 'alignment' (a power of two).
+    // Returns NULL if the current buffer does not have enough space left.
+    void* alloc( uint32_t bytes, uint32_t alignment = 16 ) {
+        uintptr_t base = ( uintptr_t )m_pBuffers[ m_Current ];
+        uintptr_t ptr = ( base + m_Offset + alignment - 1 ) &
+            ~( uintptr_t )( alignment - 1 );
+        if( ptr + bytes > base + m_Capacity ) {
+            return NULL;
+        }
+        m_Offset = ( uint32_t )( ptr + bytes - base );
+        return ( void* )ptr;
+    }
+    // Frees all allocations of the current buffer.
+    void reset( void );
+    // Ends the frame of a double buffered arena: switches to the other
+    // buffer and resets it. Works like reset() for a single buffer.
+    void swap( void );
+    // Returns true if ptr was allocated from the current or (for a double
+    // buffered arena) the previous frame's buffer
+    bool contains( const void* ptr );
+};
+
+/**
+ * LIFO allocator for variable sized temporaries of nested phases such as
+ * level loading and shader compilation.
+ * Allocations are bumped from a preallocated buffer. getMarker() records
+ * the current position and freeToMarker() releases everything allocated
+ * after it, so a phase frees all its temporaries at once.
+ *
+ * The stack is double-ended: alloc() grows the bottom end upwards and
+ * allocTop() grows the top end downwards. Long-lived data (e.g. loaded
+ * level data) can be kept at one end while the other end is used for
+ * short-lived temporaries. Both ends have their own markers.
+ */
+class StackAllocator {
+public:
+    // Position of one end of the stack, as an offset into the buffer
+    typedef uint32_t Marker;
+
+private:
+    uint8_t*    m_pBuffer;
+    // Size of the buffer (in bytes)
+    uint32_t    m_Capacity;
+    // Offset of the first free byte above the bottom allocations
+    uint32_t    m_Bottom;
+    // Offset just past the last free byte below the top allocations
+    uint32_t    m_Top;
+
+    // Disable copy constructor
+    StackAllocator( const StackAllocator& copy );
+
+public:
+    // Allocates the buffer of 'capacity' bytes.
+    explicit StackAllocator( uint32_t capacity );
+    // Destructor frees the buffer.
+    ~StackAllocator( void );
+
+    // Getters:
+    uint32_t getCapacity( void ) { return m_Capacity; }
+    uint32_t getFreeBytes( void ) { return m_Top - m_Bottom; }
+
+    // Allocates 'bytes' aligned to 'alignment' (a power of two) from the
+    // bottom end. Returns NULL if the ends would meet.
+    void* alloc( uint32_t bytes, uint32_t alignment = 16 );
+    // Same as alloc(), but from the top end.
+    void* allocTop( uint32_t bytes, uint32_t alignment = 16 );
+
+    // Returns the current position of the bottom / top end.
+    Marker getMarker( void ) { return m_Bottom; }
+    Marker getTopMarker( void ) { return m_Top; }
+    // Frees all allocations made from the bottom / top end after the
+    // marker was taken.
+    void freeToMarker( Marker marker );
+    void freeToTopMarker( Marker marker );
+    // Frees everything from both ends.
+    void clear( void ) { m_Bottom = 0; m_Top = m_Capacity; }
+};
+
+/**
+ * Frees the bottom end allocations of a StackAllocator made during the
+ * lifetime of this object, so nested scopes release their temporaries
+ * on every return path.
+ */
+class StackScope {
+private:
+    StackAllocator&         m_Stack;
+    StackAllocator::Marker  m_Marker;
+
+    // Disable copy constructor
+    StackScope( const StackScope& copy );
+
+public:
+    explicit StackScope( StackAllocator& stack ) :
+        m_Stack( stack ), m_Marker( stack.getMarker() ) {}
+    ~StackScope( void ) { m_Stack.freeToMarker( m_Marker ); }
+};
+
+/**
+ * Pool of objects of type T on top of a MemoryPool.
+ * create() constructs an object in a free block and destroy() runs the
+ * destructor before returning the block. An occupancy bitmap with one bit
+ * per block tracks the live objects, so forEach() can visit them all in
+ * address order in one sweep over the pool.
+ *
+ * The pool has a fixed capacity (one chunk) and create() returns NULL
+ * when it is full. T may not need a larger alignment than a pointer.
+ */
+template< class T >
+class ObjectPool {
+private:
+    MemoryPool  m_Pool;
+    // One bit per block, set while the block holds a live object
+    uint64_t*   m_pOccupancy;
+    uint32_t    m_WordCount;
+    uint32_t    m_LiveCount;
+
+    // Disable copy constructor
+    ObjectPool( const ObjectPool& copy );
+
+    // Block size for T: at least a pointer, and a multiple of the pointer
+    // size so that every payload stays aligned
+    static uint32_t getBlockSize( void ) {
+        uint32_t size = sizeof( T ) > sizeof( void* ) ? sizeof( T ) : sizeof( void* );
+        return ( size + sizeof( void* ) - 1 ) & ~( uint32_t )( sizeof( void* ) - 1 );
+    }
+    uint32_t getIndex( T* ptr ) {
+        return ( uint32_t )( ( ( uint8_t* )ptr - SIZE_MEM_BLOCK_HEADER -
+            ( uint8_t* )m_Pool.getPoolPtr() ) / m_Pool.getBlockStride() );
+    }
+    T* getObject( uint32_t index ) {
+        return ( T* )( ( uint8_t* )m_Pool.getPoolPtr() +
+            ( size_t )index * m_Pool.getBlockStride() + SIZE_MEM_BLOCK_HEADER );
+    }
+    static uint32_t getLowestBit( uint64_t word ) {
+#ifdef __GNUC__
+        return ( uint32_t )__builtin_ctzll( word );
+#else
+        uint32_t bit = 0;
+        while( ( word & 1 ) == 0 ) { word >>= 1; bit++; }
+        return bit;
+#endif
+    }
+
+public:
+    // Allocates room for 'capacity' objects.
+    explicit ObjectPool( uint32_t capacity ) :
+        m_Pool( getBlockSize(), capacity ),
+        m_WordCount( ( capacity + 63 ) / 64 ),
+        m_LiveCount( 0 ) {
+        static_assert( alignof( T ) <= alignof( void* ),
+            "ObjectPool does not support over-aligned types" );
+        m_pOccupancy = new uint64_t[ m_WordCount ]();
+    }
+    // Destroys the objects still alive and frees the pool.
+    ~ObjectPool( void ) {
+        forEach( [ this ]( T& object ) { destroy( &object ); } );
+        delete[] m_pOccupancy;
+    }
+
+    uint32_t getCapacity( void ) { return m_Pool.getBlockCount(); }
+    uint32_t getLiveCount( void ) { return m_LiveCount; }
+
+    // Constructs an object from the arguments. Returns NULL if the pool
+    // is full. If the constructor throws, the block is returned to the
+    // pool and the exception is passed on.
+    template< class... Args >
+    T* create( Args&&... args ) {
+        if( m_Pool.isExhausted() ) {
+            return NULL;
+        }
+        void* block_ptr = m_Pool.alloc();
+        T* ptr;
+        try {
+            ptr = new( block_ptr ) T( std::forward< Args >( args )... );
+        }
+        catch( ... ) {
+            m_Pool.dealloc( block_ptr );
+            throw;
+        }
+        uint32_t index = getIndex( ptr );
+        m_pOccupancy[ index / 64 ] |= ( uint64_t )1 << ( index % 64 );
+        m_LiveCount++;
+        return ptr;
+    }
+    // Destroys an object created by this pool.
+    void destroy( T* ptr ) {
+        uint32_t index = getIndex( ptr );
+        m_pOccupancy[ index / 64 ] &= ~( ( uint64_t )1 << ( index % 64 ) );
+        m_LiveCount--;
+        ptr->~T();
+        m_Pool.dealloc( ptr );
+    }
+
+    // Calls func( T& ) for every live object in address order. The
+    // function may destroy the object it is given.
+    template< class F >
+    void forEach( F func ) {
+        for( uint32_t w = 0; w < m_WordCount; w++ ) {
+            uint64_t word = m_pOccupancy[ w ];
+            while( word != 0 ) {
+                uint32_t bit = getLowestBit( word );
+                word &= word - 1;
+                func( *getObject( w * 64 + bit ) );
+            }
+        }
+    }
+};
+
+/**
+ * Fixed size block pool which can be shared by any number of threads.
+ * The free list is a lock-free (Treiber) stack. Blocks are linked by their
+ * index in the pool, and the head is a 64-bit word holding the index of the
+ * first free block together with a tag that is incremented on every
+ * update. A CAS on the head therefore fails if the stack has changed in
+ * between, even if the same block is on top again (ABA problem).
+ *
+ * Block layout is identical to MemoryPool: a header followed by the
+ * payload, and alloc() returns the payload address.
+ */
+class ConcurrentMemoryPool {
+private:
+    // Block index stored in the head for an empty stack
+    static const uint32_t kNullIndex = 0xFFFFFFFF;
+
+    // Pointer to pool's address space (the address returned by malloc)
+    void*                   m_pPool;
+    // Size of one memory block (in bytes)
+    uint32_t                m_BlockSize;
+    // Distance between two consecutive blocks (header + block size,
+    // rounded up to alignof( std::max_align_t ))
+    uint32_t                m_BlockStride;
+    // Number of memory block in the pool
+    uint32_t                m_BlockCount;
+    // Pool's id for distinguishing multiple pools
+    uint16_t                m_PoolId;
+    // Head of the free list: tag in the high, block index in the low 32 bits
+    std::atomic< uint64_t > m_FreeHead;
+    // Number of free blocks, maintained next to the stack
+    std::atomic< uint32_t > m_FreeCount;
+
+    // Disable copy constructor
+    ConcurrentMemoryPool( const ConcurrentMemoryPool& copy );
+
+    // Returns the block at given index and the link stored in its payload
+    MemBlockStr* getBlock( uint32_t index ) {
+        return ( MemBlockStr* )( ( uint8_t* )m_pPool +
+            ( size_t )index * m_BlockStride );
+    }
+    std::atomic< uint32_t >* getLink( MemBlockStr* block_ptr ) {
+        return ( std::atomic< uint32_t >* )(
+            ( uint8_t* )block_ptr + SIZE_MEM_BLOCK_HEADER );
+    }
+
+public:
+    // Allocates memory and initializes the blocks.
+    explicit ConcurrentMemoryPool( uint32_t block_size, uint32_t block_count );
+    // Destructor frees the allocated memory.
+    ~ConcurrentMemoryPool( void );
+
     // Getters and setters:
     void* getPoolPtr( void ) { return m_pPool; }
     uint32_t getBlockSize( void ) { return m_BlockSize; }
@@ -73,11 +846,75 @@ public:
     void setPoolId( uint16_t id ) { m_PoolId = id; }
 
     // Returns one free block from the pool. If no free blocks, returns NULL.
+    // Safe to call from any thread.
     void* alloc( void );
     // Sets the given block back into the pool as a free block.
+    // Safe to call from any thread, not only the allocating one.
+    void dealloc( void* ptr );
+    // Returns the number of free memory blocks in the pool (a snapshot
+    // if other threads are allocating at the same time).
+    uint32_t getFreeBlockCount( void ) { return m_FreeCount.load(); }
+};
+
+class MemPoolManager;
+
+/**
+ * Per-thread front end for MemPoolManager.
+ * Holds a magazine (a small stack of free blocks) for every pool of the
+ * manager. Allocations and deallocations are served from the magazine
+ * without any locking. An empty magazine is refilled with kMagazineSize
+ * blocks from the shared pool, and a full one flushes kMagazineSize blocks
+ * back, so the pool lock is taken once per kMagazineSize operations at most.
+ *
+ * Caches are created on demand by MemPoolManager when thread caching is
+ * enabled and are flushed back to the pools when their thread exits.
+ * Pools added after a cache was created are not cached by it: their
+ * blocks are freed straight back to the pool.
+ */
+class ThreadCache {
+    // Manager keeps track of all caches it has handed out
+    friend class MemPoolManager;
+public:
+    // Number of blocks moved between a magazine and its pool at once
+    static const uint32_t kMagazineSize = 32;
+
+private:
+    struct MagazineStr {
+        MemoryPool* pPool;
+        uint32_t count;
+        void* blocks[ 2 * kMagazineSize ];
+    };
+
+    // Manager this cache serves, NULL if the manager has been destroyed
+    MemPoolManager* m_pManager;
+    // One magazine per pool, indexed by the manager's size class index
+    MagazineStr* m_pMagazines;
+    uint16_t m_MagazineCount;
+    // Links in the manager's list of caches
+    ThreadCache* m_pNext;
+    ThreadCache* m_pPrev;
+
+    // Disable copy constructor
+    ThreadCache( const ThreadCache& copy );
+
+    // Moves up to kMagazineSize blocks from the pool into the magazine.
+    // Returns false if the pool had no free blocks.
+    bool refill( MagazineStr* mag_ptr );
+    // Moves the kMagazineSize least recently freed blocks back to the pool.
+    void flush( MagazineStr* mag_ptr );
+
+public:
+    // Creates magazines for the current pools of the manager
+    explicit ThreadCache( MemPoolManager* manager_ptr );
+    // Returns all cached blocks to their pools
+    ~ThreadCache();
+
+    // Allocates a block from the magazine of the most suitable pool
+    void* alloc( uint32_t bytes );
+    // Puts the block into the magazine of its pool
     void dealloc( void* ptr );
-    // Returns the number of free memory blocks in the pool
-    uint32_t getFreeBlockCount( void );
+    // Returns all cached blocks to their pools
+    void flushAll( void );
 };
 
 /**
@@ -85,7 +922,29 @@ public:
  * and deallocations to correct pools.
  */
 class MemPoolManager {
+    // Thread caches share the size class lookup
+    friend class ThreadCache;
+public:
+    // Request sizes are rounded up to this before the table lookup
+    static const uint32_t kSizeClassGranularity = 8;
+    // Largest request size covered by the lookup table. Larger requests
+    // are matched by walking the size classes above the table.
+    static const uint32_t kMaxSizeClassTableBytes = 64 * 1024;
+    // Maximum number of pools in one manager (pool ids are 0..255)
+    static const uint16_t kMaxPoolCount = 256;
+    // Number of histogram entries recorded in profiling mode
+    static const uint32_t kProfileBucketCount =
+        kMaxSizeClassTableBytes / kSizeClassGranularity + 2;
+    // Number of allocation tags, tag 0 collects untagged allocations
+    static const uint32_t kMaxTagCount = 256;
+    // Number of thread cache slots of a thread. Each manager has its own
+    // slot while at most this many managers exist, beyond that managers
+    // share slots and replace each other's caches.
+    static const uint32_t kThreadCacheSlots = 16;
+
 private:
+    // Block layout shared by all pools of the manager
+    MemPoolConfigStr::LayoutEnum m_Layout;
     // Custom linked list structures for browsing through different pools
     struct MemPoolNodeStr {
         MemPoolNodeStr* pNext;
@@ -99,8 +958,62 @@ private:
 
     // Linked list of managed memory pools
     MemPoolListStr m_PoolList;
-    // Running number for new pool IDs
-    uint32_t m_PoolIdCounter;
+    // Pools in the order of the list (increasing block size), rebuilt
+    // whenever the pool set changes
+    MemoryPool** m_pSizeClasses;
+    uint16_t m_SizeClassCount;
+    // Lookup table from rounded request size to the index of the first
+    // size class that may fit it. Entry i covers requests of
+    // ( ( i - 1 ) * kSizeClassGranularity, i * kSizeClassGranularity ] bytes.
+    uint16_t* m_pSizeClassTable;
+    uint32_t m_SizeClassTableLen;
+    // Pools indexed by their id. Ids are handed out as the lowest free
+    // slot so the table stays dense.
+    MemoryPool* m_PoolTable[ kMaxPoolCount ];
+    // Size class index of each pool, indexed by pool id
+    uint16_t m_PoolSizeClass[ kMaxPoolCount ];
+    // Whether alloc/dealloc go through per-thread caches
+    bool m_ThreadCaching;
+    // List of thread caches created for this manager
+    ThreadCache* m_pCacheList;
+    // Index of this manager's cache in the cache slots of each thread
+    uint32_t m_CacheSlot;
+    std::mutex m_CacheListLock;
+    // Allocation histogram recorded in profiling mode, one entry per
+    // kSizeClassGranularity bytes of request size. Entry 0 is unused and
+    // the last one collects the requests above kMaxSizeClassTableBytes.
+    struct MemPoolProfileEntryStr {
+        std::atomic< uint32_t > requests;
+        std::atomic< uint32_t > live;
+        std::atomic< uint32_t > peak;
+    };
+    MemPoolProfileEntryStr* m_pProfile;
+    bool m_Profiling;
+    // Usage of each allocation tag, recorded in telemetry mode
+    struct MemPoolTagEntryStr {
+        const char* name;
+        uint64_t budget_bytes;
+        std::atomic< uint32_t > live_blocks;
+        std::atomic< uint64_t > live_bytes;
+        std::atomic< uint64_t > peak_bytes;
+        std::atomic< uint32_t > over_budget_allocs;
+    };
+    MemPoolTagEntryStr* m_pTags;
+    bool m_Telemetry;
+    // Set once telemetry has been enabled. From then on every dealloc
+    // releases the charge of a counted block, also while telemetry is
+    // off, so the live counts stay exact across sessions.
+    bool m_TelemetryCounted;
+    // Manager wide counters. Failures and fall-throughs are always
+    // counted, the rest in telemetry mode.
+    std::atomic< uint32_t > m_LiveBlocks;
+    std::atomic< uint32_t > m_PeakBlocks;
+    std::atomic< uint64_t > m_LiveBytes;
+    std::atomic< uint64_t > m_PeakBytes;
+    std::atomic< uint32_t > m_FailedAllocs;
+    std::atomic< uint32_t > m_Fallthroughs;
+    std::atomic< uint64_t > m_RequestedBytes;
+    std::atomic< uint64_t > m_WastedBytes;
 
     // Disable copy constructor
     MemPoolManager( const MemPoolManager& copy );
@@ -109,11 +1022,83 @@ private:
     void insertPoolNode( MemPoolNodeStr* node_ptr );
     void removePoolNode( MemPoolNodeStr* node_ptr );
 
+    // Rebuilds size class array and lookup table from the pool list
+    void rebuildSizeClasses( void );
+    // Returns the index of the smallest size class that fits given bytes,
+    // or m_SizeClassCount if none does
+    uint16_t findSizeClass( uint32_t bytes ) {
+        uint32_t slot = ( bytes + kSizeClassGranularity - 1 ) / kSizeClassGranularity;
+        uint16_t index = 0;
+        if( slot < m_SizeClassTableLen ) {
+            index = m_pSizeClassTable[ slot ];
+        }
+        else if( m_SizeClassTableLen > 0 ) {
+            index = m_pSizeClassTable[ m_SizeClassTableLen - 1 ];
+        }
+        while( index < m_SizeClassCount &&
+               m_pSizeClasses[ index ]->getBlockSize() < bytes ) {
+            index++;
+        }
+        return index;
+    }
+
+    // Returns the pool with given id or NULL
+    MemoryPool* getPool( uint16_t id ) {
+        return id < kMaxPoolCount ? m_PoolTable[ id ] : NULL;
+    }
+    // Returns the id stored in the header of an allocated block. The
+    // header holds the pool id in bits 0..7, the allocation tag in bits
+    // 8..15 and the telemetry flag in bit 30.
+    static uint16_t getBlockPoolId( void* ptr ) {
+        MemBlockStr* block_ptr = ( MemBlockStr* )(
+            ( uint8_t* )ptr - SIZE_MEM_BLOCK_HEADER );
+        return block_ptr->header & 0xFF;
+    }
+    // Returns the pool owning an allocated block
+    MemoryPool* getBlockPool( void* ptr ) {
+        if( m_Layout == MemPoolConfigStr::LAYOUT_ALIGNED ) {
+            return MemoryPool::getChunkPool( ptr );
+        }
+        return getPool( getBlockPoolId( ptr ) );
+    }
+
+    // Histogram entry of a request size
+    static uint32_t getProfileBucket( uint32_t bytes ) {
+        uint32_t bucket = ( bytes + kSizeClassGranularity - 1 ) / kSizeClassGranularity;
+        if( bucket == 0 ) {
+            bucket = 1;
+        }
+        return bucket < kProfileBucketCount - 1 ? bucket : kProfileBucketCount - 1;
+    }
+    // Update the histogram. The histogram entry of a block is kept in
+    // the unused bits 16..29 of its header until it is deallocated.
+    void recordAlloc( void* ptr, uint32_t bytes );
+    void recordDealloc( void* ptr );
+    // Update the telemetry counters. The tag of a block and a flag telling
+    // that the block was counted are kept in its header.
+    void recordTelemetryAlloc( void* ptr, uint32_t bytes, uint8_t tag );
+    void recordTelemetryDealloc( void* ptr );
+    // Creates the tag table on first use
+    void createTags( void );
+
+    // Returns the calling thread's cache for this manager
+    ThreadCache* getThreadCache( void );
+    // Hands out the least used thread cache slot and gives it back
+    static uint32_t acquireCacheSlot( void );
+    static void releaseCacheSlot( uint32_t slot );
+    // Adds and removes caches from the list of caches
+    void registerCache( ThreadCache* cache_ptr );
+    void unregisterCache( ThreadCache* cache_ptr );
+
 public:
-    MemPoolManager();
+    // All pools added to the manager must use the given block layout
+    explicit MemPoolManager( MemPoolConfigStr::LayoutEnum layout =
+        MemPoolConfigStr::LAYOUT_HEADER );
     ~MemPoolManager();
 
-    // Inserts new pool into the list and assigns id for the pool
+    // Inserts new pool into the list and assigns id for the pool.
+    // Returns false if the manager already has kMaxPoolCount pools or
+    // if the pool's layout differs from the manager's.
     bool addPool( MemoryPool* pool_ptr );
     // Removes and destroys pool based on given id
     bool removePool( uint16_t id );
@@ -123,10 +1108,82 @@ public:
     void clearAllPools( void );
     // Returns number of pools in the list
     uint16_t getPoolCount( void );
-    // Chooses the most suitable pool and allocates block from it
-    void* alloc( uint32_t bytes );
+    // Returns the block size of the largest pool, 0 if there are no pools
+    uint32_t getMaxBlockSize( void ) {
+        return m_SizeClassCount > 0 ?
+            m_pSizeClasses[ m_SizeClassCount - 1 ]->getBlockSize() : 0;
+    }
+    // Chooses the most suitable pool and allocates block from it. The
+    // block is charged to the given tag in telemetry mode.
+    void* alloc( uint32_t bytes, uint8_t tag = 0 );
     // deallocates a block from correct pool
     void dealloc( void* ptr );
+    // Allocates 'count' blocks of 'bytes' into ptr_array, choosing the
+    // size class once for the whole batch. Returns the number of blocks
+    // allocated, which is less than count only if the pools ran out.
+    uint32_t allocBatch( uint32_t bytes, uint32_t count, void** ptr_array,
+        uint8_t tag = 0 );
+    // Deallocates 'count' blocks. Consecutive blocks of the same pool are
+    // returned to it as one batch.
+    void deallocBatch( void** ptr_array, uint32_t count );
+    // Trims all pools (see MemoryPool::trim) except those bound to
+    // another owner thread. Blocks held by thread caches count as used.
+    // Returns the number of bytes released.
+    size_t trim( void );
+    // Routes alloc/dealloc through per-thread caches, which makes them
+    // safe to call from multiple threads. Pools must be added before
+    // enabling and must not be removed while caching is on.
+    void setThreadCaching( bool enable ) { m_ThreadCaching = enable; }
+    bool isThreadCaching( void ) { return m_ThreadCaching; }
+
+    // Profiling mode records how many blocks of each request size are
+    // allocated and the peak number alive at once. Enabling clears the
+    // previous recording, disabling keeps it for recommendPools().
+    // Only managers of LAYOUT_HEADER pools can profile; returns false
+    // for others.
+    bool setProfiling( bool enable );
+    bool isProfiling( void ) { return m_Profiling; }
+    // Recorded request count and peak live count of a request size
+    // (rounded up to kSizeClassGranularity)
+    uint32_t getProfiledRequests( uint32_t bytes );
+    uint32_t getProfiledPeak( uint32_t bytes );
+    // Fits at most max_pools size classes to the recorded peaks so that
+    // the internal fragmentation at peak load is the smallest possible.
+    // Block counts are the summed peaks of the sizes in a class plus
+    // headroom_percent. Returns the number of specs written.
+    uint16_t recommendPools( MemPoolSpecStr* spec_array, uint16_t max_pools,
+        uint32_t headroom_percent = 10 );
+    // Writes the recommendation into a pool configuration file, one
+    // "block_size block_count" line per pool
+    bool writePoolConfig( const char* path, uint16_t max_pools,
+        uint32_t headroom_percent = 10 );
+    // Creates and adds the pools listed in a pool configuration file,
+    // using 'config' for the other pool settings. Returns false if the
+    // file can not be read or a pool can not be added.
+    bool addPoolsFromConfig( const char* path,
+        const MemPoolConfigStr& config = MemPoolConfigStr() );
+
+    // Telemetry mode keeps live and peak counts of the whole manager and
+    // of each allocation tag, so that subsystems can be given budgets.
+    // Enabling clears the peaks and the byte totals. Blocks counted in an
+    // earlier session stay in the live counts until freed; blocks
+    // allocated while telemetry was off are never counted. Only managers
+    // of LAYOUT_HEADER pools can record telemetry; returns false for
+    // others.
+    bool setTelemetry( bool enable );
+    bool isTelemetry( void ) { return m_Telemetry; }
+    // Names a tag for logStats(). The string must outlive the manager.
+    void setTagName( uint8_t tag, const char* name );
+    // Sets a budget in bytes for a tag, 0 removes it. The budget is soft:
+    // allocations over it succeed but are counted in the tag's stats.
+    void setTagBudget( uint8_t tag, uint64_t bytes );
+    // Copies the current counters; cheap enough to poll every frame
+    void getStats( MemPoolStatsStr& stats );
+    void getTagStats( uint8_t tag, MemPoolTagStatsStr& stats );
+    // Resets the peaks of the manager and its tags to the live values
+    void resetPeaks( void );
+    // Writes the manager stats and a line per used or named tag
+    void logStats( FILE* fp );
 };
 
 // Global variable to hold pointer to mem pool manager to be used
@@ -139,5 +1196,78 @@ extern MemPoolManager* __kMEMPOOLMANAGER;
 
 #define POOL_ALLOC( bytes ) __kMEMPOOLMANAGER->alloc( bytes )
 #define POOL_DEALLOC( ptr ) __kMEMPOOLMANAGER->dealloc( ptr )
+#define POOL_ALLOC_BATCH( bytes, count, ptr_array ) \
+    __kMEMPOOLMANAGER->allocBatch( bytes, count, ptr_array )
+#define POOL_DEALLOC_BATCH( ptr_array, count ) \
+    __kMEMPOOLMANAGER->deallocBatch( ptr_array, count )
+
+/**
+ * Allocator for standard containers, e.g.
+ *   std::list< int, PoolAllocator< int > > list( PoolAllocator< int >( &manager ) );
+ * Allocations that fit in the largest pool of the manager are served by
+ * MemPoolManager::alloc, larger ones (e.g. vector storage) by malloc.
+ * Since the choice depends only on the size, deallocate() can repeat it,
+ * which is why the pools of the manager must not change while containers
+ * hold memory from it.
+ * A full pool set throws std::bad_alloc like the default allocator, so
+ * the pools should be allowed to grow.
+ *
+ * The allocator is stateful: each instance refers to a manager, and
+ * containers may use their own managers. The default constructed
+ * allocator uses __kMEMPOOLMANAGER.
+ */
+template< class T >
+class PoolAllocator {
+private:
+    MemPoolManager* m_pManager;
+
+public:
+    typedef T value_type;
+    // Containers take their manager along when copied, moved or swapped
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    PoolAllocator( void ) : m_pManager( __kMEMPOOLMANAGER ) {}
+    explicit PoolAllocator( MemPoolManager* manager_ptr ) :
+        m_pManager( manager_ptr ) {}
+    template< class U >
+    PoolAllocator( const PoolAllocator< U >& other ) :
+        m_pManager( other.getManager() ) {}
+
+    MemPoolManager* getManager( void ) const { return m_pManager; }
+
+    T* allocate( size_t n ) {
+        size_t bytes = n * sizeof( T );
+        void* ptr = NULL;
+        if( bytes <= m_pManager->getMaxBlockSize() ) {
+            ptr = m_pManager->alloc( ( uint32_t )bytes );
+        }
+        else {
+            ptr = malloc( bytes );
+        }
+        if( ptr == NULL ) {
+            throw std::bad_alloc();
+        }
+        return ( T* )ptr;
+    }
+    void deallocate( T* ptr, size_t n ) {
+        if( n * sizeof( T ) <= m_pManager->getMaxBlockSize() ) {
+            m_pManager->dealloc( ptr );
+        }
+        else {
+            free( ptr );
+        }
+    }
+};
+
+template< class T, class U >
+bool operator==( const PoolAllocator< T >& a, const PoolAllocator< U >& b ) {
+    return a.getManager() == b.getManager();
+}
+template< class T, class U >
+bool operator!=( const PoolAllocator< T >& a, const PoolAllocator< U >& b ) {
+    return a.getManager() != b.getManager();
+}
 
 #endif /* #ifndef MEM_POOL_H */
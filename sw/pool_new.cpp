@@ -0,0 +1,174 @@
+/******************************************************************************/
+/**
+    Pool backed global operator new and delete for Testocore engine.
+    Copyright (C) 2013 Pekka Mkinen
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+/******************************************************************************/
+#include <stdlib.h>
+#include <stdint.h>
+#include <new>
+#include "mem_pool.h"
+#include "pool_new.h"
+
+namespace {
+
+// Bytes in front of a system block: the pointer returned by malloc and
+// a header word in the position of the MemBlockStr header of pool blocks
+const size_t kSystemHeaderBytes = 16;
+
+// Block sizes of the size classes. Each stride (size + block header) is
+// a multiple of 16, which keeps every payload 16 byte aligned.
+const uint32_t kPoolNewBlockSizes[] = {
+    8, 24, 40, 56, 88, 120, 184, 248, 376, 504, 760, 1016 };
+const uint32_t kPoolNewPoolBlocks = 1024;
+
+// Set while the allocator itself allocates (manager set up, creating
+// thread caches). Those requests go to the system allocator.
+thread_local bool t_InPoolNew = false;
+
+MemPoolManager* createManager( void ) {
+    t_InPoolNew = true;
+    MemPoolConfigStr config;
+    config.growth = MemPoolConfigStr::GROWTH_GEOMETRIC;
+    MemPoolManager* manager_ptr = new MemPoolManager();
+    for( uint32_t i = 0; i < sizeof( kPoolNewBlockSizes ) / sizeof( uint32_t ); i++ ) {
+        manager_ptr->addPool(
+            new MemoryPool( kPoolNewBlockSizes[ i ], kPoolNewPoolBlocks, config ) );
+    }
+    manager_ptr->setThreadCaching( true );
+    t_InPoolNew = false;
+    return manager_ptr;
+}
+
+/*
+ * Returns the manager, creating it on first use. The manager is never
+ * destroyed, as blocks may be deleted until the very end of the process.
+ */
+MemPoolManager* getManager( void ) {
+    static MemPoolManager* s_pManager = createManager();
+    return s_pManager;
+}
+
+uint32_t getHeaderWord( const void* ptr ) {
+    return *( const uint32_t* )( ( const uint8_t* )ptr - SIZE_MEM_BLOCK_HEADER );
+}
+
+/*
+ * Allocates from malloc with a system block header, aligned to
+ * 'alignment' (at least 16).
+ */
+void* systemAlloc( size_t size, size_t alignment ) {
+    uint8_t* base_ptr = ( uint8_t* )malloc( size + kSystemHeaderBytes + alignment - 16 );
+    if( base_ptr == NULL ) {
+        return NULL;
+    }
+    uint8_t* ptr = ( uint8_t* )( ( ( uintptr_t )base_ptr + kSystemHeaderBytes +
+        alignment - 1 ) & ~( uintptr_t )( alignment - 1 ) );
+    *( void** )( ptr - kSystemHeaderBytes ) = base_ptr;
+    *( uint32_t* )( ptr - SIZE_MEM_BLOCK_HEADER ) = 0;
+    return ptr;
+}
+
+void* poolNew( size_t size, size_t alignment ) {
+    void* ptr = NULL;
+    if( size <= kPoolNewMaxBytes && alignment <= 16 && !t_InPoolNew ) {
+        MemPoolManager* manager_ptr = getManager();
+        t_InPoolNew = true;
+        ptr = manager_ptr->alloc( size > 0 ? ( uint32_t )size : 1 );
+        t_InPoolNew = false;
+    }
+    if( ptr == NULL ) {
+        ptr = systemAlloc( size, alignment < 16 ? 16 : alignment );
+    }
+    return ptr;
+}
+
+void poolDelete( void* ptr ) {
+    if( ptr == NULL ) {
+        return;
+    }
+    if( getHeaderWord( ptr ) & ( 1u << 31 ) ) {
+        bool in_pool_new = t_InPoolNew;
+        t_InPoolNew = true;
+        getManager()->dealloc( ptr );
+        t_InPoolNew = in_pool_new;
+    }
+    else {
+        free( *( void** )( ( uint8_t* )ptr - kSystemHeaderBytes ) );
+    }
+}
+
+void* throwingNew( size_t size, size_t alignment ) {
+    void* ptr = poolNew( size, alignment );
+    if( ptr == NULL ) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+} // namespace
+
+bool isPoolNewBlock( const void* ptr ) {
+    return ( getHeaderWord( ptr ) & ( 1u << 31 ) ) != 0;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Replaced global operators */
+/*----------------------------------------------------------------------------*/
+
+void* operator new( size_t size ) { return throwingNew( size, 16 ); }
+void* operator new[]( size_t size ) { return throwingNew( size, 16 ); }
+void* operator new( size_t size, const std::nothrow_t& ) noexcept {
+    return poolNew( size, 16 );
+}
+void* operator new[]( size_t size, const std::nothrow_t& ) noexcept {
+    return poolNew( size, 16 );
+}
+
+void operator delete( void* ptr ) noexcept { poolDelete( ptr ); }
+void operator delete[]( void* ptr ) noexcept { poolDelete( ptr ); }
+void operator delete( void* ptr, const std::nothrow_t& ) noexcept { poolDelete( ptr ); }
+void operator delete[]( void* ptr, const std::nothrow_t& ) noexcept { poolDelete( ptr ); }
+void operator delete( void* ptr, size_t ) noexcept { poolDelete( ptr ); }
+void operator delete[]( void* ptr, size_t ) noexcept { poolDelete( ptr ); }
+
+#ifdef __cpp_aligned_new
+void* operator new( size_t size, std::align_val_t alignment ) {
+    return throwingNew( size, ( size_t )alignment );
+}
+void* operator new[]( size_t size, std::align_val_t alignment ) {
+    return throwingNew( size, ( size_t )alignment );
+}
+void* operator new( size_t size, std::align_val_t alignment,
+    const std::nothrow_t& ) noexcept {
+    return poolNew( size, ( size_t )alignment );
+}
+void* operator new[]( size_t size, std::align_val_t alignment,
+    const std::nothrow_t& ) noexcept {
+    return poolNew( size, ( size_t )alignment );
+}
+void operator delete( void* ptr, std::align_val_t ) noexcept { poolDelete( ptr ); }
+void operator delete[]( void* ptr, std::align_val_t ) noexcept { poolDelete( ptr ); }
+void operator delete( void* ptr, size_t, std::align_val_t ) noexcept { poolDelete( ptr ); }
+void operator delete[]( void* ptr, size_t, std::align_val_t ) noexcept { poolDelete( ptr ); }
+void operator delete( void* ptr, std::align_val_t, const std::nothrow_t& ) noexcept {
+    poolDelete( ptr );
+}
+void operator delete[]( void* ptr, std::align_val_t, const std::nothrow_t& ) noexcept {
+    poolDelete( ptr );
+}
+#endif /* #ifdef __cpp_aligned_new */
@@ -6,6 +6,7 @@ TEMPLATE = app
 CONFIG += console
 CONFIG -= app_bundle
 CONFIG -= qt
+CONFIG += c++11 thread
 
 TARGET = testocore
 INCLUDEPATH += .
@@ -25,5 +26,15 @@ SOURCES += sw/mem_pool.cpp \
            sw/gl_renderer.cpp \
            ut/ut_mem_pool.cpp \
            ut/ut_gl_renderer.cpp \
-           ut/ut_playground.cpp
+           ut/ut_playground.cpp \
+           ut/ut_list.cpp
+
+# The pool backed global operator new (ut_pool_new in ut/makefile)
+# replaces operator new of the whole binary. Enable with:
+#   qmake CONFIG+=pool_new
+pool_new {
+    HEADERS += sw/pool_new.h
+    SOURCES += sw/pool_new.cpp \
+               ut/ut_pool_new.cpp
+}
 
@@ -315,7 +315,7 @@ void TestCase::runTest( void ) {
     // Set global pointer for mempool allocations
     __kMEMPOOLMANAGER = PoolMngr;
 
-    GLRenderer Renderer = GLRenderer( GLRenderer::ALLOC_TYPE_MEM_POOL );
+    GLRenderer Renderer;
 
     if( !Renderer.loadShaders(
         "../../sw/shaders/vertex_shader.glsl",
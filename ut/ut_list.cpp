@@ -0,0 +1,871 @@
+/******************************************************************************/
+/**
+    Test script for linked lists ( Testocore project )
+    Copyright (C) 2013 Pekka Mkinen
+    makinpek [ at ] gmail
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+/******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fstream>
+#include <string>
+#include <sstream>
+#include <memory>
+#include <iterator>
+#include <vector>
+
+// Testocore headers:
+#define DEFINE_MEMPOOL_MANAGER_GLOBAL
+#include "mem_pool.h"
+#include "list.h"
+#include "timer.h"
+#include "ut.h"
+
+class TestCase : public TestCaseBase {
+    public:
+    TestCase( const char* name ) : TestCaseBase( name ) {}
+    ~TestCase() { }
+    void runTest();
+};
+
+// Element type of the tests, in two intrusive lists at once
+enum { TAG_UPDATE = 0, TAG_DRAW = 1 };
+struct ElementStr : public ListHook< ElementStr, TAG_UPDATE >,
+                    public ListHook< ElementStr, TAG_DRAW > {
+    uint32_t value;
+    float    pos[ 3 ];
+};
+
+// Payload of the emplace tests, counts its copies and moves
+struct HeavyStr {
+    static uint32_t copies;
+    static uint32_t moves;
+    uint32_t    id;
+    float       matrix[ 16 ];
+    std::string name;
+
+    HeavyStr( uint32_t new_id, const char* new_name ) : id( new_id ), name( new_name ) {
+        memset( matrix, 0, sizeof( matrix ) );
+    }
+    HeavyStr( const HeavyStr& other ) : id( other.id ), name( other.name ) {
+        memcpy( matrix, other.matrix, sizeof( matrix ) );
+        ++copies;
+    }
+    HeavyStr( HeavyStr&& other ) : id( other.id ), name( std::move( other.name ) ) {
+        memcpy( matrix, other.matrix, sizeof( matrix ) );
+        ++moves;
+    }
+    HeavyStr& operator=( const HeavyStr& other ) {
+        id = other.id;
+        name = other.name;
+        memcpy( matrix, other.matrix, sizeof( matrix ) );
+        ++copies;
+        return *this;
+    }
+    HeavyStr& operator=( HeavyStr&& other ) {
+        id = other.id;
+        name = std::move( other.name );
+        memcpy( matrix, other.matrix, sizeof( matrix ) );
+        ++moves;
+        return *this;
+    }
+};
+uint32_t HeavyStr::copies = 0;
+uint32_t HeavyStr::moves = 0;
+
+// Node allocation policy that counts the allocator calls of a list
+struct CountingAlloc : public ListAllocNew {
+    static uint32_t calls;
+    static uint32_t batch_calls;
+    void* alloc( size_t bytes ) { calls++; return ListAllocNew::alloc( bytes ); }
+    void dealloc( void* ptr ) { calls++; ListAllocNew::dealloc( ptr ); }
+    uint32_t allocBatch( size_t bytes, uint32_t count, void** ptr_array ) {
+        batch_calls++;
+        return ListAllocNew::allocBatch( bytes, count, ptr_array );
+    }
+    void deallocBatch( void** ptr_array, uint32_t count ) {
+        batch_calls++;
+        ListAllocNew::deallocBatch( ptr_array, count );
+    }
+};
+uint32_t CountingAlloc::calls = 0;
+uint32_t CountingAlloc::batch_calls = 0;
+
+// Payload whose copy constructor throws for one value, counts live objects
+struct ThrowOnCopyStr {
+    static const uint32_t kThrowValue = 100;
+    static uint32_t live;
+    uint32_t value;
+    ThrowOnCopyStr( uint32_t new_value ) : value( new_value ) { ++live; }
+    ThrowOnCopyStr( const ThrowOnCopyStr& other ) : value( other.value ) {
+        if( value == kThrowValue ) throw value;
+        ++live;
+    }
+    ~ThrowOnCopyStr() { --live; }
+};
+uint32_t ThrowOnCopyStr::live = 0;
+
+// Largest element count of the benchmarks
+static const uint32_t kMaxBenchElements = 1000000;
+
+// Fills, walks and empties a List< ElementStr* >, returns the walk sum
+template <class Alloc>
+static uint64_t benchList( ElementStr* element_array, uint32_t count,
+    const Alloc& alloc, uint32_t& fill_ms, uint32_t& walk_ms, uint32_t& clear_ms ) {
+    List< ElementStr*, Alloc > ElementList( alloc );
+    Timer timer = Timer();
+    for( uint32_t i = 0; i < count; i++ ) {
+        ElementList.pushBack( &element_array[ i ] );
+    }
+    fill_ms = timer.getElapsed();
+    uint64_t sum = 0;
+    timer = Timer();
+    for( uint32_t pass = 0; pass < 10; pass++ ) {
+        for( Node< ElementStr* >* node_ptr = ElementList.head(); node_ptr != NULL;
+             node_ptr = node_ptr->next() ) {
+            sum += ( **node_ptr )->value;
+        }
+    }
+    walk_ms = timer.getElapsed();
+    timer = Timer();
+    ElementList.clear();
+    clear_ms = timer.getElapsed();
+    return sum;
+}
+
+// Same for an IntrusiveList< ElementStr >
+static uint64_t benchIntrusive( ElementStr* element_array, uint32_t count,
+    uint32_t& fill_ms, uint32_t& walk_ms, uint32_t& clear_ms ) {
+    IntrusiveList< ElementStr > ElementList;
+    Timer timer = Timer();
+    for( uint32_t i = 0; i < count; i++ ) {
+        ElementList.pushBack( &element_array[ i ] );
+    }
+    fill_ms = timer.getElapsed();
+    uint64_t sum = 0;
+    timer = Timer();
+    for( uint32_t pass = 0; pass < 10; pass++ ) {
+        for( ElementStr* element_ptr = ElementList.begin(); element_ptr != NULL;
+             element_ptr = ElementList.next( element_ptr ) ) {
+            sum += element_ptr->value;
+        }
+    }
+    walk_ms = timer.getElapsed();
+    timer = Timer();
+    ElementList.clear();
+    clear_ms = timer.getElapsed();
+    return sum;
+}
+
+int main( void ) {
+
+    TestCase TC( "ut_list" );
+
+    TC.execute();
+
+    return 0;
+}
+
+/* -----------------------------------------------------------------------------
+ * Define test script here.
+ */
+void TestCase::runTest( void ) {
+
+/* ------------------------------
+   TC step 1
+
+   IntrusiveList: linking and
+   unlinking elements
+   ------------------------------ */
+
+    UT_START_STEP( 1 );
+
+    ElementStr elements[ 5 ];
+    for( uint32_t i = 0; i < 5; i++ ) {
+        elements[ i ].value = i;
+    }
+    IntrusiveList< ElementStr, TAG_UPDATE > UpdateList;
+    IntrusiveList< ElementStr, TAG_DRAW > DrawList;
+    UpdateList.pushBack( &elements[ 1 ] );
+    UpdateList.pushBack( &elements[ 2 ] );
+    UpdateList.pushFront( &elements[ 0 ] );
+    UpdateList.pushBack( &elements[ 3 ] );
+    // The same elements in reverse order in the other list
+    for( uint32_t i = 0; i < 4; i++ ) {
+        DrawList.pushFront( &elements[ i ] );
+    }
+    UT_CHECK_OUTPUT( UpdateList.size() == 4 && DrawList.size() == 4 );
+    uint32_t expected = 0;
+    bool order_ok = true;
+    for( ElementStr* element_ptr = UpdateList.begin(); element_ptr != NULL;
+         element_ptr = UpdateList.next( element_ptr ) ) {
+        if( element_ptr->value != expected++ ) order_ok = false;
+    }
+    for( ElementStr* element_ptr = DrawList.begin(); element_ptr != NULL;
+         element_ptr = DrawList.next( element_ptr ) ) {
+        if( element_ptr->value != --expected ) order_ok = false;
+    }
+    UT_CHECK_OUTPUT( order_ok );
+
+    UT_COMMENT( "Removing the middle, head and tail\n" );
+    UpdateList.remove( &elements[ 2 ] );
+    UT_CHECK_OUTPUT( UpdateList.next( &elements[ 1 ] ) == &elements[ 3 ] );
+    UT_CHECK_OUTPUT( UpdateList.prev( &elements[ 3 ] ) == &elements[ 1 ] );
+    UpdateList.remove( &elements[ 0 ] );
+    UpdateList.remove( &elements[ 3 ] );
+    UT_CHECK_OUTPUT( UpdateList.begin() == &elements[ 1 ] );
+    UT_CHECK_OUTPUT( UpdateList.end() == &elements[ 1 ] );
+    UT_CHECK_OUTPUT( UpdateList.size() == 1 );
+    // Removing from one list leaves the other intact
+    UT_CHECK_OUTPUT( DrawList.size() == 4 && DrawList.end() == &elements[ 0 ] );
+    UpdateList.remove( &elements[ 1 ] );
+    UT_CHECK_OUTPUT( UpdateList.begin() == NULL && UpdateList.end() == NULL );
+
+    DrawList.clear();
+    UT_CHECK_OUTPUT( DrawList.size() == 0 && DrawList.begin() == NULL );
+    UT_CHECK_OUTPUT( DrawList.next( &elements[ 2 ] ) == NULL );
+    // Cleared elements can be linked again
+    DrawList.pushBack( &elements[ 4 ] );
+    DrawList.pushBack( &elements[ 2 ] );
+    UT_CHECK_OUTPUT( DrawList.begin() == &elements[ 4 ] && DrawList.size() == 2 );
+
+    UT_COMMENT( "List< T > gives the same order\n" );
+    List< ElementStr* > PointerList;
+    PointerList.pushFront( &elements[ 1 ] );
+    PointerList.pushFront( &elements[ 0 ] );
+    PointerList.pushBack( &elements[ 2 ] );
+    UT_CHECK_OUTPUT( PointerList.size() == 3 );
+    UT_CHECK_OUTPUT( PointerList.head()->item() == &elements[ 0 ] );
+    UT_CHECK_OUTPUT( PointerList.tail()->item() == &elements[ 2 ] );
+
+    UT_END_STEP;
+
+/* ------------------------------
+   TC step 2
+
+   Benchmark: List< T* > with new
+   and pool nodes, IntrusiveList
+   ------------------------------ */
+
+    UT_START_STEP( 2 );
+
+    MemPoolManager* PoolMngr = new MemPoolManager();
+    PoolMngr->addPool( new MemoryPool( sizeof( Node< ElementStr* > ), kMaxBenchElements ) );
+    __kMEMPOOLMANAGER = PoolMngr;
+
+    ElementStr* element_array = new ElementStr[ kMaxBenchElements ];
+    for( uint32_t i = 0; i < kMaxBenchElements; i++ ) {
+        element_array[ i ].value = i;
+    }
+
+    UT_COMMENT( "Fill, 10 walks and clear, times in ms:\n" );
+    for( uint32_t count = 10000; count <= kMaxBenchElements; count *= 10 ) {
+        uint32_t fill_ms, walk_ms, clear_ms;
+        uint64_t expected_sum = ( uint64_t )count * ( count - 1 ) / 2 * 10;
+
+        uint64_t sum = benchList( element_array, count,
+            ListAllocNew(), fill_ms, walk_ms, clear_ms );
+        UT_CHECK_OUTPUT( sum == expected_sum );
+        UT_COMMENT( count << " elements, List (new):\t" << fill_ms << " / " <<
+            walk_ms << " / " << clear_ms << "\n" );
+
+        sum = benchList( element_array, count,
+            ListAllocGlobalPool(), fill_ms, walk_ms, clear_ms );
+        UT_CHECK_OUTPUT( sum == expected_sum );
+        UT_COMMENT( count << " elements, List (pool):\t" << fill_ms << " / " <<
+            walk_ms << " / " << clear_ms << "\n" );
+
+        sum = benchIntrusive( element_array, count, fill_ms, walk_ms, clear_ms );
+        UT_CHECK_OUTPUT( sum == expected_sum );
+        UT_COMMENT( count << " elements, IntrusiveList:\t" << fill_ms << " / " <<
+            walk_ms << " / " << clear_ms << "\n" );
+    }
+
+    delete[] element_array;
+    __kMEMPOOLMANAGER = NULL;
+    delete PoolMngr;
+
+    UT_END_STEP;
+
+/* ------------------------------
+   TC step 3
+
+   UnrolledList: chunked storage,
+   erase and traversal benchmark
+   ------------------------------ */
+
+    UT_START_STEP( 3 );
+
+    typedef UnrolledList< uint32_t > ValueList;
+    ValueList Values;
+    for( uint32_t i = 0; i < 1000; i++ ) {
+        Values.pushBack( i );
+    }
+    UT_CHECK_OUTPUT( Values.size() == 1000 );
+    UT_CHECK_OUTPUT( Values.getChunkCount() ==
+        ( 1000 + ValueList::kChunkCapacity - 1 ) / ValueList::kChunkCapacity );
+    UT_COMMENT( ValueList::kChunkCapacity << " items per 256 byte chunk\n" );
+
+    // Erase the odd values while walking
+    for( ValueList::Cursor c = Values.begin(); c.isValid(); ) {
+        if( *c % 2 == 1 ) c = Values.erase( c );
+        else c = Values.next( c );
+    }
+    UT_CHECK_OUTPUT( Values.size() == 500 );
+    uint32_t expected_value = 0;
+    bool values_ok = true;
+    for( ValueList::Cursor c = Values.begin(); c.isValid(); c = Values.next( c ) ) {
+        if( *c != expected_value ) values_ok = false;
+        expected_value += 2;
+    }
+    UT_CHECK_OUTPUT( values_ok && expected_value == 1000 );
+    // Emptied chunks are released
+    for( ValueList::Cursor c = Values.begin(); c.isValid(); ) {
+        c = *c < 500 ? Values.erase( c ) : Values.next( c );
+    }
+    UT_CHECK_OUTPUT( Values.size() == 250 && *Values.begin() == 500 );
+    UT_CHECK_OUTPUT( Values.getChunkCount() <
+        ( 1000 + ValueList::kChunkCapacity - 1 ) / ValueList::kChunkCapacity );
+
+    UT_COMMENT( "Items with destructors\n" );
+    {
+        UnrolledList< std::string > Strings;
+        for( uint32_t i = 0; i < 100; i++ ) {
+            std::stringstream ss;
+            ss << "item " << i;
+            Strings.pushBack( ss.str() );
+        }
+        UnrolledList< std::string >::Cursor c = Strings.erase( Strings.begin() );
+        UT_CHECK_OUTPUT( *c == "item 1" && Strings.size() == 99 );
+        Strings.clear();
+        UT_CHECK_OUTPUT( Strings.size() == 0 && !Strings.begin().isValid() );
+    }
+
+    UT_COMMENT( "erase moves the following items instead of copying them\n" );
+    {
+        UnrolledList< HeavyStr, 1024 > HeavyList;
+        for( uint32_t i = 0; i < 8; i++ ) {
+            HeavyList.pushBack( HeavyStr( i, "a heavy payload name" ) );
+        }
+        UT_CHECK_OUTPUT( HeavyList.getChunkCount() == 1 );
+        HeavyStr::copies = 0;
+        HeavyStr::moves = 0;
+        UnrolledList< HeavyStr, 1024 >::Cursor c = HeavyList.erase( HeavyList.begin() );
+        UT_CHECK_OUTPUT( HeavyStr::copies == 0 && HeavyStr::moves == 7 );
+        UT_CHECK_OUTPUT( c->id == 1 && c->name == "a heavy payload name" );
+    }
+
+    UT_COMMENT( "Items of pooled chunks are aligned for their type\n" );
+    {
+        typedef UnrolledList< double, 256, ListAllocPool > DoubleList;
+        MemoryPool ChunkPool( 256, 4 );
+        DoubleList Doubles( ( ListAllocPool( &ChunkPool ) ) );
+        for( uint32_t i = 0; i < 3 * DoubleList::kChunkCapacity; i++ ) {
+            Doubles.pushBack( i * 0.5 );
+        }
+        UT_CHECK_OUTPUT( Doubles.getChunkCount() == 3 );
+        bool aligned = true;
+        for( DoubleList::Cursor c = Doubles.begin(); c.isValid(); c = Doubles.next( c ) ) {
+            if( ( uintptr_t )&*c % alignof( double ) != 0 ) aligned = false;
+        }
+        UT_CHECK_OUTPUT( aligned == true );
+    }
+
+    UT_COMMENT( "10 walks over " << kMaxBenchElements << " pointers, times in ms:\n" );
+    {
+        MemPoolManager* ChunkMngr = new MemPoolManager();
+        ChunkMngr->addPool( new MemoryPool( sizeof( Node< ElementStr* > ), kMaxBenchElements ) );
+        __kMEMPOOLMANAGER = ChunkMngr;
+        ElementStr* bench_array = new ElementStr[ kMaxBenchElements ];
+        List< ElementStr*, ListAllocGlobalPool > PointerBenchList;
+        UnrolledList< ElementStr* > UnrolledBenchList;
+        for( uint32_t i = 0; i < kMaxBenchElements; i++ ) {
+            bench_array[ i ].value = i;
+            PointerBenchList.pushBack( &bench_array[ i ] );
+            UnrolledBenchList.pushBack( &bench_array[ i ] );
+        }
+        uint64_t list_sum = 0;
+        Timer timer = Timer();
+        for( uint32_t pass = 0; pass < 10; pass++ ) {
+            for( Node< ElementStr* >* node_ptr = PointerBenchList.head(); node_ptr != NULL;
+                 node_ptr = node_ptr->next() ) {
+                list_sum += ( uintptr_t )**node_ptr;
+            }
+        }
+        uint32_t list_ms = timer.getElapsed();
+        uint64_t unrolled_sum = 0;
+        timer = Timer();
+        for( uint32_t pass = 0; pass < 10; pass++ ) {
+            for( UnrolledList< ElementStr* >::Cursor c = UnrolledBenchList.begin();
+                 c.isValid(); c = UnrolledBenchList.next( c ) ) {
+                unrolled_sum += ( uintptr_t )*c;
+            }
+        }
+        uint32_t unrolled_ms = timer.getElapsed();
+        UT_CHECK_OUTPUT( list_sum == unrolled_sum );
+        UT_COMMENT( "List (pool): " << list_ms << ", UnrolledList: " << unrolled_ms <<
+            " (" << UnrolledBenchList.getChunkCount() << " chunks)\n" );
+        PointerBenchList.clear();
+        delete[] bench_array;
+        __kMEMPOOLMANAGER = NULL;
+        delete ChunkMngr;
+    }
+
+    UT_END_STEP;
+
+/* ------------------------------
+   TC step 4
+
+   List: allocation policies
+   ------------------------------ */
+
+    UT_START_STEP( 4 );
+
+    UT_COMMENT( "Nodes of a private pool are contiguous\n" );
+    {
+        MemoryPool NodePool( sizeof( Node< uint32_t > ), 3 );
+        List< uint32_t, ListAllocPool > PoolList( ( ListAllocPool( &NodePool ) ) );
+        UT_CHECK_OUTPUT( PoolList.pushBack( 1 ) && PoolList.pushBack( 2 ) );
+        UT_CHECK_OUTPUT( PoolList.pushFront( 0 ) );
+        UT_CHECK_OUTPUT( ( uint8_t* )PoolList.tail() - ( uint8_t* )PoolList.head()->next() ==
+            ( ptrdiff_t )NodePool.getBlockStride() );
+        // The pool is full
+        UT_CHECK_OUTPUT( !PoolList.pushBack( 3 ) && PoolList.size() == 3 );
+        PoolList.remove( PoolList.head() );
+        UT_CHECK_OUTPUT( NodePool.getUsedBlockCount() == 2 );
+        PoolList.clear();
+        UT_CHECK_OUTPUT( NodePool.getUsedBlockCount() == 0 );
+    }
+
+    UT_COMMENT( "Frame arena nodes\n" );
+    {
+        FrameArena NodeArena( 64 * 1024 );
+        {
+            List< uint32_t, ListAllocArena > ArenaList( ( ListAllocArena( &NodeArena ) ) );
+            for( uint32_t i = 0; i < 100; i++ ) {
+                ArenaList.pushBack( i );
+            }
+            UT_CHECK_OUTPUT( ArenaList.size() == 100 && **ArenaList.tail() == 99 );
+            UT_CHECK_OUTPUT( NodeArena.getUsedBytes() >= 100 * sizeof( Node< uint32_t > ) );
+        }
+        NodeArena.reset();
+    }
+
+    UT_COMMENT( "Fill, 10 walks and clear of " << kMaxBenchElements <<
+        " elements, times in ms:\n" );
+    {
+        ElementStr* element_array = new ElementStr[ kMaxBenchElements ];
+        for( uint32_t i = 0; i < kMaxBenchElements; i++ ) {
+            element_array[ i ].value = i;
+        }
+        uint64_t expected_sum = ( uint64_t )kMaxBenchElements * ( kMaxBenchElements - 1 ) / 2 * 10;
+        uint32_t fill_ms, walk_ms, clear_ms;
+        uint64_t sum;
+
+        sum = benchList( element_array, kMaxBenchElements, ListAllocNew(),
+            fill_ms, walk_ms, clear_ms );
+        UT_CHECK_OUTPUT( sum == expected_sum );
+        UT_COMMENT( "new:\t\t\t" << fill_ms << " / " << walk_ms << " / " << clear_ms << "\n" );
+
+        MemPoolManager* GlobalMngr = new MemPoolManager();
+        GlobalMngr->addPool( new MemoryPool( sizeof( Node< ElementStr* > ), kMaxBenchElements ) );
+        __kMEMPOOLMANAGER = GlobalMngr;
+        sum = benchList( element_array, kMaxBenchElements, ListAllocGlobalPool(),
+            fill_ms, walk_ms, clear_ms );
+        UT_CHECK_OUTPUT( sum == expected_sum );
+        UT_COMMENT( "global pool manager:\t" << fill_ms << " / " << walk_ms << " / " << clear_ms << "\n" );
+
+        GlobalMngr->setThreadCaching( true );
+        sum = benchList( element_array, kMaxBenchElements, ListAllocManager( GlobalMngr ),
+            fill_ms, walk_ms, clear_ms );
+        UT_CHECK_OUTPUT( sum == expected_sum );
+        UT_COMMENT( "thread cache:\t\t" << fill_ms << " / " << walk_ms << " / " << clear_ms << "\n" );
+        __kMEMPOOLMANAGER = NULL;
+        delete GlobalMngr;
+
+        MemoryPool* NodePool = new MemoryPool( sizeof( Node< ElementStr* > ), kMaxBenchElements );
+        sum = benchList( element_array, kMaxBenchElements, ListAllocPool( NodePool ),
+            fill_ms, walk_ms, clear_ms );
+        UT_CHECK_OUTPUT( sum == expected_sum );
+        UT_COMMENT( "private pool:\t\t" << fill_ms << " / " << walk_ms << " / " << clear_ms << "\n" );
+        delete NodePool;
+
+        // Arena allocations are 16 byte aligned
+        FrameArena* NodeArena = new FrameArena( kMaxBenchElements *
+            ( ( sizeof( Node< ElementStr* > ) + 15 ) & ~15 ) );
+        sum = benchList( element_array, kMaxBenchElements, ListAllocArena( NodeArena ),
+            fill_ms, walk_ms, clear_ms );
+        UT_CHECK_OUTPUT( sum == expected_sum );
+        UT_COMMENT( "frame arena:\t\t" << fill_ms << " / " << walk_ms << " / " << clear_ms << "\n" );
+        delete NodeArena;
+
+        delete[] element_array;
+    }
+
+    UT_END_STEP;
+
+/* ------------------------------
+   TC step 5
+
+   List: emplace, move-only payloads,
+   iterators and heavy payload benchmark
+   ------------------------------ */
+
+    UT_START_STEP( 5 );
+
+    UT_COMMENT( "Emplace constructs in place, push moves\n" );
+    {
+        List< HeavyStr > HeavyList;
+        HeavyStr::copies = 0;
+        HeavyStr::moves = 0;
+        UT_CHECK_OUTPUT( HeavyList.emplaceBack( 1, "one" ) );
+        UT_CHECK_OUTPUT( HeavyList.emplaceFront( 0, "zero" ) );
+        UT_CHECK_OUTPUT( HeavyStr::copies == 0 && HeavyStr::moves == 0 );
+        HeavyStr heavy( 2, "two" );
+        HeavyList.pushBack( heavy );
+        UT_CHECK_OUTPUT( HeavyStr::copies == 1 && HeavyStr::moves == 0 );
+        HeavyList.pushBack( std::move( heavy ) );
+        UT_CHECK_OUTPUT( HeavyStr::copies == 1 && HeavyStr::moves == 1 );
+        UT_CHECK_OUTPUT( HeavyList.size() == 4 && HeavyList.head()->item().name == "zero" );
+        UT_CHECK_OUTPUT( HeavyList.tail()->item().name == "two" );
+    }
+
+    UT_COMMENT( "Move-only payloads\n" );
+    {
+        List< std::unique_ptr< ElementStr > > OwnerList;
+        for( uint32_t i = 0; i < 10; i++ ) {
+            std::unique_ptr< ElementStr > element_ptr( new ElementStr() );
+            element_ptr->value = i;
+            UT_CHECK_OUTPUT( OwnerList.pushBack( std::move( element_ptr ) ) );
+            UT_CHECK_OUTPUT( element_ptr.get() == NULL );
+        }
+        UT_CHECK_OUTPUT( OwnerList.emplaceFront( new ElementStr() ) );
+        UT_CHECK_OUTPUT( OwnerList.size() == 11 );
+        OwnerList.remove( OwnerList.head() );
+        UT_CHECK_OUTPUT( OwnerList.size() == 10 && ( *OwnerList.begin() )->value == 0 );
+        // The list owns the elements, clear() deletes them
+        OwnerList.clear();
+        UT_CHECK_OUTPUT( OwnerList.size() == 0 && OwnerList.isEmpty() );
+    }
+
+    UT_COMMENT( "Bidirectional iterators\n" );
+    {
+        List< uint32_t > ValueList;
+        for( uint32_t i = 0; i < 100; i++ ) {
+            ValueList.pushBack( i );
+        }
+        uint32_t sum = 0;
+        for( uint32_t& value : ValueList ) {
+            sum += value;
+        }
+        UT_CHECK_OUTPUT( sum == 4950 );
+        UT_CHECK_OUTPUT( std::distance( ValueList.begin(), ValueList.end() ) == 100 );
+
+        // Walk backwards from end()
+        List< uint32_t >::Iterator it = ValueList.end();
+        --it;
+        UT_CHECK_OUTPUT( *it == 99 && *--it == 98 );
+
+        // Erase the odd values while walking
+        for( List< uint32_t >::Iterator erase_it = ValueList.begin(); erase_it != ValueList.end(); ) {
+            if( *erase_it & 1 ) erase_it = ValueList.erase( erase_it );
+            else ++erase_it;
+        }
+        UT_CHECK_OUTPUT( ValueList.size() == 50 && **ValueList.tail() == 98 );
+
+        const List< uint32_t >& ConstList = ValueList;
+        sum = 0;
+        for( List< uint32_t >::ConstIterator const_it = ConstList.begin(); const_it != ConstList.end(); ++const_it ) {
+            sum += *const_it;
+        }
+        UT_CHECK_OUTPUT( sum == 2450 );
+    }
+
+    UT_COMMENT( "Heavy payloads: fill / walk ms\n" );
+    {
+        const uint32_t count = 100000;
+        HeavyStr::copies = 0;
+        HeavyStr::moves = 0;
+        {
+            List< HeavyStr > HeavyList;
+            Timer timer = Timer();
+            for( uint32_t i = 0; i < count; i++ ) {
+                HeavyStr heavy( i, "a heavy payload name" );
+                HeavyList.pushBack( heavy );
+            }
+            uint32_t fill_ms = timer.getElapsed();
+            uint64_t sum = 0;
+            timer = Timer();
+            for( Node< HeavyStr >* node_ptr = HeavyList.head(); node_ptr != NULL;
+                 node_ptr = node_ptr->next() ) {
+                sum += node_ptr->item().id;
+            }
+            uint32_t walk_ms = timer.getElapsed();
+            UT_CHECK_OUTPUT( sum == ( uint64_t )count * ( count - 1 ) / 2 );
+            UT_COMMENT( "copy in, node walk:\t" << fill_ms << " / " << walk_ms << "\n" );
+        }
+        UT_CHECK_OUTPUT( HeavyStr::copies == count );
+        {
+            List< HeavyStr > HeavyList;
+            Timer timer = Timer();
+            for( uint32_t i = 0; i < count; i++ ) {
+                HeavyList.emplaceBack( i, "a heavy payload name" );
+            }
+            uint32_t fill_ms = timer.getElapsed();
+            uint64_t sum = 0;
+            timer = Timer();
+            for( const HeavyStr& heavy : HeavyList ) {
+                sum += heavy.id;
+            }
+            uint32_t walk_ms = timer.getElapsed();
+            UT_CHECK_OUTPUT( sum == ( uint64_t )count * ( count - 1 ) / 2 );
+            UT_COMMENT( "emplace, range-for:\t" << fill_ms << " / " << walk_ms << "\n" );
+        }
+        UT_CHECK_OUTPUT( HeavyStr::copies == count && HeavyStr::moves == 0 );
+    }
+
+    UT_END_STEP;
+
+/* ------------------------------
+   TC step 6
+
+   List: range insert, splice, removeIf
+   and per-frame churn benchmark
+   ------------------------------ */
+
+    UT_START_STEP( 6 );
+
+    UT_COMMENT( "Range insert\n" );
+    {
+        uint32_t values[ 200 ];
+        for( uint32_t i = 0; i < 200; i++ ) {
+            values[ i ] = i;
+        }
+        List< uint32_t > ValueList;
+        UT_CHECK_OUTPUT( ValueList.insert( ValueList.end(), values + 100, values + 200 ) == 100 );
+        UT_CHECK_OUTPUT( ValueList.insert( ValueList.begin(), values, values + 50 ) == 50 );
+        // Into the middle, before 100
+        List< uint32_t >::Iterator pos = ValueList.begin();
+        std::advance( pos, 50 );
+        UT_CHECK_OUTPUT( ValueList.insert( pos, values + 50, values + 100 ) == 50 );
+        UT_CHECK_OUTPUT( ValueList.size() == 200 );
+        uint32_t expected = 0;
+        bool in_order = true;
+        for( uint32_t value : ValueList ) {
+            in_order = in_order && value == expected++;
+        }
+        UT_CHECK_OUTPUT( in_order && **ValueList.tail() == 199 );
+        UT_CHECK_OUTPUT( ValueList.insert( ValueList.end(), values, values ) == 0 );
+    }
+
+    UT_COMMENT( "Bulk operations call the allocator once per batch\n" );
+    {
+        uint32_t values[ 1000 ] = { 0 };
+        for( uint32_t i = 0; i < 1000; i++ ) {
+            values[ i ] = i;
+        }
+        List< uint32_t, CountingAlloc > CountedList;
+        CountingAlloc::calls = 0;
+        CountingAlloc::batch_calls = 0;
+        UT_CHECK_OUTPUT( CountedList.insert( CountedList.end(), values, values + 1000 ) == 1000 );
+        UT_CHECK_OUTPUT( CountingAlloc::calls == 0 && CountingAlloc::batch_calls == 16 );
+        CountingAlloc::batch_calls = 0;
+        UT_CHECK_OUTPUT( CountedList.removeIf( [] ( uint32_t value ) { return value < 500; } ) == 500 );
+        UT_CHECK_OUTPUT( CountingAlloc::calls == 0 && CountingAlloc::batch_calls == 8 );
+        CountingAlloc::batch_calls = 0;
+        CountedList.clear();
+        UT_CHECK_OUTPUT( CountingAlloc::calls == 0 && CountingAlloc::batch_calls == 8 );
+    }
+
+    UT_COMMENT( "Range insert from a private pool\n" );
+    {
+        uint32_t values[ 100 ] = { 0 };
+        MemoryPool NodePool( sizeof( Node< uint32_t > ), 80 );
+        List< uint32_t, ListAllocPool > PoolList( ( ListAllocPool( &NodePool ) ) );
+        // The pool runs out after 80 nodes
+        UT_CHECK_OUTPUT( PoolList.insert( PoolList.end(), values, values + 100 ) == 80 );
+        UT_CHECK_OUTPUT( PoolList.size() == 80 && NodePool.getUsedBlockCount() == 80 );
+        PoolList.clear();
+        UT_CHECK_OUTPUT( NodePool.getUsedBlockCount() == 0 );
+    }
+
+    UT_COMMENT( "A throwing copy leaves the list unchanged\n" );
+    {
+        std::vector< ThrowOnCopyStr > sources;
+        sources.reserve( 150 );
+        for( uint32_t i = 0; i < 150; i++ ) {
+            sources.emplace_back( i );
+        }
+        MemoryPool NodePool( sizeof( Node< ThrowOnCopyStr > ), 200 );
+        List< ThrowOnCopyStr, ListAllocPool > ThrowList( ( ListAllocPool( &NodePool ) ) );
+        ThrowList.pushBack( ThrowOnCopyStr( 1000 ) );
+        // The copy of item 100 throws in the second batch
+        bool thrown = false;
+        try {
+            ThrowList.insert( ThrowList.begin(), sources.begin(), sources.end() );
+        }
+        catch( uint32_t ) {
+            thrown = true;
+        }
+        UT_CHECK_OUTPUT( thrown == true );
+        UT_CHECK_OUTPUT( ThrowList.size() == 1 && ThrowList.begin()->value == 1000 );
+        UT_CHECK_OUTPUT( NodePool.getUsedBlockCount() == 1 );
+        UT_CHECK_OUTPUT( ThrowOnCopyStr::live == 151 );
+        // Same for a single node
+        thrown = false;
+        try {
+            ThrowList.pushBack( sources[ ThrowOnCopyStr::kThrowValue ] );
+        }
+        catch( uint32_t ) {
+            thrown = true;
+        }
+        UT_CHECK_OUTPUT( thrown == true && ThrowList.size() == 1 );
+        UT_CHECK_OUTPUT( NodePool.getUsedBlockCount() == 1 );
+    }
+    UT_CHECK_OUTPUT( ThrowOnCopyStr::live == 0 );
+
+    UT_COMMENT( "Splice\n" );
+    {
+        List< uint32_t > FrontList;
+        List< uint32_t > MiddleList;
+        List< uint32_t > BackList;
+        for( uint32_t i = 0; i < 10; i++ ) {
+            FrontList.pushBack( i );
+            MiddleList.pushBack( 10 + i );
+            BackList.pushBack( 20 + i );
+        }
+        FrontList.splice( FrontList.end(), BackList );
+        UT_CHECK_OUTPUT( FrontList.size() == 20 && BackList.size() == 0 );
+        UT_CHECK_OUTPUT( BackList.begin() == BackList.end() );
+        List< uint32_t >::Iterator pos = FrontList.begin();
+        std::advance( pos, 10 );
+        FrontList.splice( pos, MiddleList );
+        FrontList.splice( FrontList.begin(), BackList );
+        FrontList.splice( FrontList.begin(), FrontList );
+        UT_CHECK_OUTPUT( FrontList.size() == 30 && MiddleList.isEmpty() );
+        uint32_t expected = 0;
+        bool in_order = true;
+        for( uint32_t value : FrontList ) {
+            in_order = in_order && value == expected++;
+        }
+        UT_CHECK_OUTPUT( in_order && expected == 30 );
+        // Backwards too
+        List< uint32_t >::Iterator it = FrontList.end();
+        while( it != FrontList.begin() ) {
+            --it;
+            in_order = in_order && *it == --expected;
+        }
+        UT_CHECK_OUTPUT( in_order && expected == 0 );
+        // The spliced list still works
+        MiddleList.pushBack( 1 );
+        UT_CHECK_OUTPUT( MiddleList.size() == 1 && **MiddleList.head() == 1 );
+    }
+
+    UT_COMMENT( "removeIf\n" );
+    {
+        MemoryPool NodePool( sizeof( Node< uint32_t > ), 1000 );
+        List< uint32_t, ListAllocPool > PoolList( ( ListAllocPool( &NodePool ) ) );
+        for( uint32_t i = 0; i < 1000; i++ ) {
+            PoolList.pushBack( i );
+        }
+        struct IsOdd {
+            bool operator()( uint32_t value ) const { return ( value & 1 ) != 0; }
+        };
+        UT_CHECK_OUTPUT( PoolList.removeIf( IsOdd() ) == 500 );
+        UT_CHECK_OUTPUT( PoolList.size() == 500 && NodePool.getUsedBlockCount() == 500 );
+        UT_CHECK_OUTPUT( **PoolList.head() == 0 && **PoolList.tail() == 998 );
+        // Head and tail removed
+        UT_CHECK_OUTPUT( PoolList.removeIf( [] ( uint32_t value ) {
+            return value == 0 || value == 998; } ) == 2 );
+        UT_CHECK_OUTPUT( **PoolList.head() == 2 && **PoolList.tail() == 996 );
+        UT_CHECK_OUTPUT( PoolList.removeIf( [] ( uint32_t ) { return true; } ) == 498 );
+        UT_CHECK_OUTPUT( PoolList.isEmpty() && PoolList.head() == NULL && PoolList.tail() == NULL );
+        UT_CHECK_OUTPUT( NodePool.getUsedBlockCount() == 0 );
+
+        // Payload destructors run
+        List< std::unique_ptr< ElementStr > > OwnerList;
+        for( uint32_t i = 0; i < 100; i++ ) {
+            OwnerList.emplaceBack( new ElementStr() );
+            ( **OwnerList.tail() )->value = i;
+        }
+        UT_CHECK_OUTPUT( OwnerList.removeIf( [] ( const std::unique_ptr< ElementStr >& element_ptr ) {
+            return element_ptr->value >= 10; } ) == 90 );
+        UT_CHECK_OUTPUT( OwnerList.size() == 10 );
+    }
+
+    UT_COMMENT( "Per-frame churn, global pool: rebuild / cull ms\n" );
+    {
+        const uint32_t count = 100000;
+        const uint32_t frames = 10;
+        ElementStr* element_array = new ElementStr[ count ];
+        ElementStr** pointer_array = new ElementStr*[ count ];
+        for( uint32_t i = 0; i < count; i++ ) {
+            element_array[ i ].value = i;
+            pointer_array[ i ] = &element_array[ i ];
+        }
+        // Every frame the list is rebuilt and every 4th element is culled.
+        // Each variant gets a fresh pool so both start from the same layout.
+        for( uint32_t batched = 0; batched < 2; batched++ ) {
+            MemPoolManager* ChurnMngr = new MemPoolManager();
+            MemoryPool* ChurnPool = new MemoryPool( sizeof( Node< ElementStr* > ), count );
+            ChurnMngr->addPool( ChurnPool );
+            __kMEMPOOLMANAGER = ChurnMngr;
+            {
+                List< ElementStr*, ListAllocGlobalPool > ElementList;
+                uint32_t rebuild_ms = 0;
+                uint32_t cull_ms = 0;
+                for( uint32_t frame = 0; frame < frames; frame++ ) {
+                    Timer timer = Timer();
+                    if( batched ) {
+                        ElementList.insert( ElementList.end(), pointer_array, pointer_array + count );
+                    }
+                    else {
+                        for( uint32_t i = 0; i < count; i++ ) {
+                            ElementList.pushBack( pointer_array[ i ] );
+                        }
+                    }
+                    rebuild_ms += timer.getElapsed();
+                    timer = Timer();
+                    if( batched ) {
+                        ElementList.removeIf( [] ( ElementStr* element_ptr ) {
+                            return ( element_ptr->value & 3 ) == 0; } );
+                    }
+                    else {
+                        for( Node< ElementStr* >* node_ptr = ElementList.head(); node_ptr != NULL; ) {
+                            Node< ElementStr* >* next_ptr = node_ptr->next();
+                            if( ( node_ptr->item()->value & 3 ) == 0 ) ElementList.remove( node_ptr );
+                            node_ptr = next_ptr;
+                        }
+                    }
+                    cull_ms += timer.getElapsed();
+                    UT_CHECK_OUTPUT( ElementList.size() == count - count / 4 );
+                    ElementList.clear();
+                }
+                UT_COMMENT( ( batched ? "batched:\t\t" : "per item:\t\t" ) <<
+                    rebuild_ms << " / " << cull_ms << "\n" );
+            }
+            UT_CHECK_OUTPUT( ChurnPool->getUsedBlockCount() == 0 );
+            __kMEMPOOLMANAGER = NULL;
+            delete ChurnMngr;
+        }
+        delete[] pointer_array;
+        delete[] element_array;
+    }
+
+    UT_END_STEP;
+
+/* ------------------------------ */
+    return;
+}
@@ -18,10 +18,19 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <time.h>
 #include <fstream>
 #include <string>
 #include <sstream>
+#include <list>
+#include <map>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <unistd.h>
+#include <sys/wait.h>
 
 // Testocore headers:
 #include "mem_pool.h"
@@ -35,6 +44,248 @@ class TestCase : public TestCaseBase {
     void runTest();
 };
 
+/* -----------------------------------------------------------------------------
+ * Worker loops for the multi-threaded benchmarks.
+ * Each worker allocates kWorkerBatch blocks of mixed sizes and frees them
+ * again, kWorkerRounds times.
+ */
+static const uint32_t kWorkerRounds = 2000;
+static const uint32_t kWorkerBatch = 256;
+static const uint32_t kWorkerSizes[ 4 ] = { 16, 48, 100, 200 };
+
+// Counts allocations that returned NULL in any worker
+static uint32_t g_WorkerFailures = 0;
+static std::mutex g_WorkerMutex;
+
+static void threadCacheWorker( MemPoolManager* manager_ptr ) {
+    void* ptr_array[ kWorkerBatch ];
+    uint32_t failures = 0;
+    for( uint32_t round = 0; round < kWorkerRounds; round++ ) {
+        for( uint32_t i = 0; i < kWorkerBatch; i++ ) {
+            ptr_array[ i ] = manager_ptr->alloc( kWorkerSizes[ i & 3 ] );
+            if( ptr_array[ i ] == NULL ) failures++;
+        }
+        for( uint32_t i = 0; i < kWorkerBatch; i++ ) {
+            if( ptr_array[ i ] != NULL ) manager_ptr->dealloc( ptr_array[ i ] );
+        }
+    }
+    std::lock_guard< std::mutex > guard( g_WorkerMutex );
+    g_WorkerFailures += failures;
+}
+
+static void lockedManagerWorker( MemPoolManager* manager_ptr ) {
+    void* ptr_array[ kWorkerBatch ];
+    for( uint32_t round = 0; round < kWorkerRounds; round++ ) {
+        for( uint32_t i = 0; i < kWorkerBatch; i++ ) {
+            std::lock_guard< std::mutex > guard( g_WorkerMutex );
+            ptr_array[ i ] = manager_ptr->alloc( kWorkerSizes[ i & 3 ] );
+        }
+        for( uint32_t i = 0; i < kWorkerBatch; i++ ) {
+            std::lock_guard< std::mutex > guard( g_WorkerMutex );
+            manager_ptr->dealloc( ptr_array[ i ] );
+        }
+    }
+}
+
+static void mallocWorker( MemPoolManager* ) {
+    void* ptr_array[ kWorkerBatch ];
+    for( uint32_t round = 0; round < kWorkerRounds; round++ ) {
+        for( uint32_t i = 0; i < kWorkerBatch; i++ ) {
+            ptr_array[ i ] = malloc( kWorkerSizes[ i & 3 ] );
+        }
+        for( uint32_t i = 0; i < kWorkerBatch; i++ ) {
+            free( ptr_array[ i ] );
+        }
+    }
+}
+
+// Wraps a single-threaded MemoryPool behind a mutex
+class LockedMemoryPool {
+    MemoryPool m_Pool;
+    std::mutex m_Mutex;
+public:
+    LockedMemoryPool( uint32_t block_size, uint32_t block_count ) :
+        m_Pool( block_size, block_count ) {}
+    void* alloc( void ) {
+        std::lock_guard< std::mutex > guard( m_Mutex );
+        return m_Pool.isExhausted() ? NULL : m_Pool.alloc();
+    }
+    void dealloc( void* ptr ) {
+        std::lock_guard< std::mutex > guard( m_Mutex );
+        m_Pool.dealloc( ptr );
+    }
+};
+
+// Same interface as the pools, forwards to malloc and free
+class MallocPool {
+    uint32_t m_BlockSize;
+public:
+    MallocPool( uint32_t block_size, uint32_t ) : m_BlockSize( block_size ) {}
+    void* alloc( void ) { return malloc( m_BlockSize ); }
+    void dealloc( void* ptr ) { free( ptr ); }
+};
+
+// MemoryPool owned by the first thread allocating from it, other threads
+// free through the remote free queue
+class RemoteFreePool {
+    MemoryPool m_Pool;
+public:
+    RemoteFreePool( uint32_t block_size, uint32_t block_count ) :
+        m_Pool( block_size, block_count ) {}
+    void* alloc( void ) {
+        if( m_Pool.getOwnerThread() == std::thread::id() ) {
+            m_Pool.setOwnerThread();
+        }
+        return m_Pool.isExhausted() ? NULL : m_Pool.alloc();
+    }
+    void dealloc( void* ptr ) { m_Pool.dealloc( ptr ); }
+    MemoryPool* getPool( void ) { return &m_Pool; }
+};
+
+template <class P>
+static void poolWorker( P* pool_ptr ) {
+    void* ptr_array[ kWorkerBatch ];
+    uint32_t failures = 0;
+    for( uint32_t round = 0; round < kWorkerRounds; round++ ) {
+        for( uint32_t i = 0; i < kWorkerBatch; i++ ) {
+            ptr_array[ i ] = pool_ptr->alloc();
+            if( ptr_array[ i ] == NULL ) failures++;
+        }
+        for( uint32_t i = 0; i < kWorkerBatch; i++ ) {
+            if( ptr_array[ i ] != NULL ) pool_ptr->dealloc( ptr_array[ i ] );
+        }
+    }
+    std::lock_guard< std::mutex > guard( g_WorkerMutex );
+    g_WorkerFailures += failures;
+}
+
+/*
+ * Producer/consumer pair: the producer allocates blocks and hands them over
+ * through a single-producer single-consumer ring, the consumer frees them.
+ */
+static const uint32_t kRingSize = 1024;
+static const uint32_t kHandoverCount = 500000;
+
+template <class P>
+struct HandoverStr {
+    P* pPool;
+    void* ring[ kRingSize ];
+    std::atomic< uint32_t > head;
+    std::atomic< uint32_t > tail;
+};
+
+template <class P>
+static void producerWorker( HandoverStr< P >* ho_ptr ) {
+    for( uint32_t i = 0; i < kHandoverCount; i++ ) {
+        void* ptr = NULL;
+        while( ( ptr = ho_ptr->pPool->alloc() ) == NULL ) {
+            std::this_thread::yield();
+        }
+        uint32_t head = ho_ptr->head.load( std::memory_order_relaxed );
+        while( head - ho_ptr->tail.load( std::memory_order_acquire ) == kRingSize ) {
+            std::this_thread::yield();
+        }
+        ho_ptr->ring[ head % kRingSize ] = ptr;
+        ho_ptr->head.store( head + 1, std::memory_order_release );
+    }
+}
+
+template <class P>
+static void consumerWorker( HandoverStr< P >* ho_ptr ) {
+    for( uint32_t i = 0; i < kHandoverCount; i++ ) {
+        uint32_t tail = ho_ptr->tail.load( std::memory_order_relaxed );
+        while( ho_ptr->head.load( std::memory_order_acquire ) == tail ) {
+            std::this_thread::yield();
+        }
+        ho_ptr->pPool->dealloc( ho_ptr->ring[ tail % kRingSize ] );
+        ho_ptr->tail.store( tail + 1, std::memory_order_release );
+    }
+}
+
+// Runs producer and consumer on their own threads, returns elapsed ms
+template <class P>
+static uint32_t runHandover( P* pool_ptr ) {
+    HandoverStr< P > ho;
+    ho.pPool = pool_ptr;
+    ho.head.store( 0 );
+    ho.tail.store( 0 );
+    Timer timer = Timer();
+    std::thread producer( producerWorker< P >, &ho );
+    std::thread consumer( consumerWorker< P >, &ho );
+    producer.join();
+    consumer.join();
+    return timer.getElapsed();
+}
+
+// Runs the worker on given number of threads and returns elapsed milliseconds
+template <class A>
+static uint32_t runWorkers( void ( *worker )( A* ),
+    A* arg_ptr, uint32_t thread_count ) {
+    std::thread* threads[ 64 ];
+    Timer timer = Timer();
+    for( uint32_t i = 0; i < thread_count; i++ ) {
+        threads[ i ] = new std::thread( worker, arg_ptr );
+    }
+    for( uint32_t i = 0; i < thread_count; i++ ) {
+        threads[ i ]->join();
+        delete threads[ i ];
+    }
+    return timer.getElapsed();
+}
+
+// Adds the pools used by the multi-threaded benchmarks
+static void addWorkerPools( MemPoolManager& manager, uint32_t thread_count,
+    MemoryPool* pools[ 4 ] ) {
+    uint32_t count = thread_count * kWorkerBatch;
+    pools[ 0 ] = new MemoryPool( 16, count );
+    pools[ 1 ] = new MemoryPool( 64, count );
+    pools[ 2 ] = new MemoryPool( 128, count );
+    pools[ 3 ] = new MemoryPool( 256, count );
+    for( uint32_t i = 0; i < 4; i++ ) {
+        manager.addPool( pools[ i ] );
+    }
+}
+
+// Object type for the ObjectPool tests, counts constructions and
+// destructions
+static int g_ParticleCount = 0;
+struct ParticleStr {
+    float pos[ 3 ];
+    float vel[ 3 ];
+    uint32_t id;
+    ParticleStr( uint32_t particle_id, float speed ) : id( particle_id ) {
+        for( int i = 0; i < 3; i++ ) { pos[ i ] = 0.0f; vel[ i ] = speed; }
+        g_ParticleCount++;
+    }
+    ~ParticleStr() { g_ParticleCount--; }
+    void update( float dt ) {
+        for( int i = 0; i < 3; i++ ) pos[ i ] += vel[ i ] * dt;
+    }
+};
+
+// Object whose constructor throws on request
+struct ThrowingStr {
+    uint32_t value;
+    explicit ThrowingStr( uint32_t init_value ) : value( init_value ) {
+        if( init_value == 0 ) throw init_value;
+    }
+};
+
+// Resident set size of the process in kB, 0 where it can not be read
+static uint32_t getResidentKb( void ) {
+    unsigned long size = 0;
+    unsigned long resident = 0;
+    FILE* fp = fopen( "/proc/self/statm", "r" );
+    if( fp == NULL ) {
+        return 0;
+    }
+    if( fscanf( fp, "%lu %lu", &size, &resident ) != 2 ) {
+        resident = 0;
+    }
+    fclose( fp );
+    return ( uint32_t )( resident * 4 );
+}
+
 int main( void ) {
 
     TestCase TC( "ut_mem_pool" );
@@ -319,6 +570,1695 @@ void TestCase::runTest( void ) {
 
     UT_END_STEP;
 
+/* ------------------------------
+   TC step 6
+
+   ThreadCache: multi-threaded allocation through
+   per-thread magazines
+   ------------------------------ */
+
+    UT_START_STEP( 6 );
+
+    uint32_t max_threads = std::thread::hardware_concurrency();
+    if( max_threads < 2 ) max_threads = 2;
+    if( max_threads > 16 ) max_threads = 16;
+
+    UT_COMMENT( "Each thread does " << kWorkerRounds << " rounds of " <<
+        kWorkerBatch << " allocations and deallocations:\n" );
+
+    for( uint32_t threads = 1; threads <= max_threads; threads *= 2 ) {
+        MemPoolManager PoolManager;
+        MemoryPool* pools[ 4 ];
+        addWorkerPools( PoolManager, threads, pools );
+        PoolManager.setThreadCaching( true );
+
+        g_WorkerFailures = 0;
+        uint32_t cached_ms = runWorkers( threadCacheWorker, &PoolManager, threads );
+        UT_CHECK_OUTPUT( g_WorkerFailures == 0 );
+
+        // Worker caches are flushed on thread exit, so all blocks must be
+        // back in the shared pools.
+        for( uint32_t i = 0; i < 4; i++ ) {
+            UT_CHECK_OUTPUT( pools[ i ]->getFreeBlockCount() ==
+                threads * kWorkerBatch );
+        }
+
+        MemPoolManager LockedManager;
+        addWorkerPools( LockedManager, threads, pools );
+        uint32_t locked_ms = runWorkers( lockedManagerWorker, &LockedManager, threads );
+        uint32_t malloc_ms = runWorkers( mallocWorker,
+            ( MemPoolManager* )NULL, threads );
+
+        UT_COMMENT( threads << " thread(s): thread cache " << cached_ms <<
+            " ms, locked manager " << locked_ms << " ms, malloc " <<
+            malloc_ms << " ms\n" );
+    }
+
+    UT_COMMENT( "Caches of two managers coexist in one thread\n" );
+    {
+        MemPoolManager FirstManager;
+        MemPoolManager SecondManager;
+        MemoryPool* first_pool = new MemoryPool( 32, 256 );
+        MemoryPool* second_pool = new MemoryPool( 32, 256 );
+        FirstManager.addPool( first_pool );
+        SecondManager.addPool( second_pool );
+        FirstManager.setThreadCaching( true );
+        SecondManager.setThreadCaching( true );
+        bool kept = true;
+        for( uint32_t i = 0; i < 100; i++ ) {
+            void* first_ptr = FirstManager.alloc( 16 );
+            void* second_ptr = SecondManager.alloc( 16 );
+            FirstManager.dealloc( first_ptr );
+            SecondManager.dealloc( second_ptr );
+            // Each magazine was refilled once and is never flushed
+            kept = kept && first_pool->getUsedBlockCount() == ThreadCache::kMagazineSize &&
+                second_pool->getUsedBlockCount() == ThreadCache::kMagazineSize;
+        }
+        UT_CHECK_OUTPUT( kept );
+
+        UT_COMMENT( "Blocks of a pool added after the cache go back to the pool\n" );
+        MemoryPool* late_pool = new MemoryPool( 128, 16 );
+        FirstManager.addPool( late_pool );
+        FirstManager.setThreadCaching( false );
+        void* late_ptr = FirstManager.alloc( 100 );
+        FirstManager.setThreadCaching( true );
+        UT_CHECK_OUTPUT( late_ptr != NULL && late_pool->getUsedBlockCount() == 1 );
+        FirstManager.dealloc( late_ptr );
+        UT_CHECK_OUTPUT( late_pool->getUsedBlockCount() == 0 );
+    }
+
+    UT_END_STEP;
+
+/* ------------------------------
+   TC step 7
+
+   ConcurrentMemoryPool: single-threaded
+   sanity and multi-threaded benchmark
+   ------------------------------ */
+
+    UT_START_STEP( 7 );
+
+    uint32_t block_count = 1000;
+    ConcurrentMemoryPool Pool( 64, block_count );
+    void* ptr_array[ 1000 ];
+
+    UT_COMMENT( "Checking free block counts and block reuse\n" );
+    UT_CHECK_OUTPUT( Pool.getFreeBlockCount() == block_count );
+    for( uint32_t i = 0; i < block_count; i++ ) {
+        ptr_array[ i ] = Pool.alloc();
+        UT_CHECK_OUTPUT( ptr_array[ i ] != NULL );
+    }
+    UT_CHECK_OUTPUT( Pool.getFreeBlockCount() == 0 );
+    UT_CHECK_OUTPUT( Pool.alloc() == NULL );
+    for( uint32_t i = 0; i < block_count; i++ ) {
+        Pool.dealloc( ptr_array[ i ] );
+    }
+    UT_CHECK_OUTPUT( Pool.getFreeBlockCount() == block_count );
+    // Stack order: last freed block comes back first
+    UT_CHECK_OUTPUT( Pool.alloc() == ptr_array[ block_count - 1 ] );
+    Pool.dealloc( ptr_array[ block_count - 1 ] );
+
+    UT_COMMENT( "Payload of odd sized blocks is pointer aligned\n" );
+    {
+        ConcurrentMemoryPool OddPool( 13, 8 );
+        void* odd_array[ 8 ];
+        bool aligned = true;
+        for( uint32_t i = 0; i < 8; i++ ) {
+            odd_array[ i ] = OddPool.alloc();
+            aligned = aligned && odd_array[ i ] != NULL &&
+                ( ( uintptr_t )odd_array[ i ] & ( sizeof( void* ) - 1 ) ) == 0;
+        }
+        UT_CHECK_OUTPUT( aligned == true );
+        for( uint32_t i = 0; i < 8; i++ ) {
+            OddPool.dealloc( odd_array[ i ] );
+        }
+        UT_CHECK_OUTPUT( OddPool.getFreeBlockCount() == 8 );
+    }
+
+    uint32_t max_threads = std::thread::hardware_concurrency();
+    if( max_threads < 2 ) max_threads = 2;
+    if( max_threads > 16 ) max_threads = 16;
+
+    UT_COMMENT( "Each thread does " << kWorkerRounds << " rounds of " <<
+        kWorkerBatch << " allocations and deallocations:\n" );
+
+    for( uint32_t threads = 1; threads <= max_threads; threads *= 2 ) {
+        uint32_t count = threads * kWorkerBatch;
+        ConcurrentMemoryPool SharedPool( 64, count );
+        LockedMemoryPool LockedPool( 64, count );
+        MallocPool Malloc( 64, count );
+
+        g_WorkerFailures = 0;
+        uint32_t lock_free_ms = runWorkers( poolWorker< ConcurrentMemoryPool >,
+            &SharedPool, threads );
+        UT_CHECK_OUTPUT( g_WorkerFailures == 0 );
+        UT_CHECK_OUTPUT( SharedPool.getFreeBlockCount() == count );
+
+        uint32_t locked_ms = runWorkers( poolWorker< LockedMemoryPool >,
+            &LockedPool, threads );
+        uint32_t malloc_ms = runWorkers( poolWorker< MallocPool >,
+            &Malloc, threads );
+
+        UT_COMMENT( threads << " thread(s): lock-free pool " << lock_free_ms <<
+            " ms, locked pool " << locked_ms << " ms, malloc " <<
+            malloc_ms << " ms\n" );
+    }
+
+    UT_COMMENT( "Producer allocates, consumer frees " << kHandoverCount <<
+        " blocks:\n" );
+    ConcurrentMemoryPool SharedPool( 64, kRingSize + 1 );
+    LockedMemoryPool LockedPool( 64, kRingSize + 1 );
+    MallocPool Malloc( 64, kRingSize + 1 );
+    uint32_t lock_free_ms = runHandover( &SharedPool );
+    UT_CHECK_OUTPUT( SharedPool.getFreeBlockCount() == kRingSize + 1 );
+    uint32_t locked_ms = runHandover( &LockedPool );
+    uint32_t malloc_ms = runHandover( &Malloc );
+    UT_COMMENT( "lock-free pool " << lock_free_ms << " ms, locked pool " <<
+        locked_ms << " ms, malloc " << malloc_ms << " ms\n" );
+
+    UT_END_STEP;
+
+/* ------------------------------
+   TC step 8
+
+   MemPoolManager: size class lookup
+   with a dozen pools
+   ------------------------------ */
+
+    UT_START_STEP( 8 );
+
+    MemPoolManager PoolManager;
+    MemoryPool* pools[ 12 ];
+
+    // Twelve size classes from 16 to 32768 bytes, added in mixed order
+    for( uint32_t i = 0; i < 12; i += 2 ) {
+        pools[ i ] = new MemoryPool( 16 << i, 100 );
+        UT_CHECK_OUTPUT( PoolManager.addPool( pools[ i ] ) == true );
+    }
+    for( uint32_t i = 1; i < 12; i += 2 ) {
+        pools[ i ] = new MemoryPool( 16 << i, 100 );
+        UT_CHECK_OUTPUT( PoolManager.addPool( pools[ i ] ) == true );
+    }
+    UT_CHECK_OUTPUT( PoolManager.getPoolCount() == 12 );
+
+    UT_COMMENT( "Checking that every request size maps to the right pool\n" );
+    bool all_ok = true;
+    for( uint32_t bytes = 1; bytes <= ( 16 << 11 ); bytes += 7 ) {
+        uint32_t expected = 0;
+        while( ( 16u << expected ) < bytes ) expected++;
+        void* ptr = PoolManager.alloc( bytes );
+        if( pools[ expected ]->getFreeBlockCount() != 99 ) all_ok = false;
+        PoolManager.dealloc( ptr );
+    }
+    UT_CHECK_OUTPUT( all_ok );
+    UT_CHECK_OUTPUT( PoolManager.alloc( ( 16 << 11 ) + 1 ) == NULL );
+
+    // Removing a pool rebuilds the table: 64 byte requests go to 128
+    UT_CHECK_OUTPUT( PoolManager.removePoolByBlockSize( 64 ) == true );
+    void* ptr = PoolManager.alloc( 64 );
+    UT_CHECK_OUTPUT( pools[ 3 ]->getFreeBlockCount() == 99 );
+    PoolManager.dealloc( ptr );
+
+    // Lookup cost should not depend on the size class
+    uint32_t loop_count = 1000000;
+    UT_COMMENT( loop_count << " allocations and deallocations:\n" );
+    for( uint32_t i = 0; i < 12; i += 11 ) {
+        uint32_t bytes = 16 << i;
+        Timer timer = Timer();
+        for( uint32_t n = 0; n < loop_count; n++ ) {
+            PoolManager.dealloc( PoolManager.alloc( bytes ) );
+        }
+        UT_COMMENT( "Size class " << bytes << " bytes:\t" <<
+            timer.getElapsed() << " ms\n" );
+    }
+
+    UT_END_STEP;
+
+/* ------------------------------
+   TC step 9
+
+   MemPoolManager: deallocation cost with
+   1 to 64 pools
+   ------------------------------ */
+
+    UT_START_STEP( 9 );
+
+    uint32_t loop_count = 1000000;
+    UT_COMMENT( loop_count << " allocations and deallocations from the " <<
+        "largest pool:\n" );
+
+    for( uint32_t pool_count = 1; pool_count <= 64; pool_count *= 2 ) {
+        MemPoolManager PoolManager;
+        for( uint32_t i = 0; i < pool_count; i++ ) {
+            UT_CHECK_OUTPUT( PoolManager.addPool(
+                new MemoryPool( 16 * ( i + 1 ), 10 ) ) == true );
+        }
+        UT_CHECK_OUTPUT( PoolManager.getPoolCount() == pool_count );
+
+        // The largest pool has the highest id
+        uint32_t bytes = 16 * pool_count;
+        Timer timer = Timer();
+        for( uint32_t n = 0; n < loop_count; n++ ) {
+            PoolManager.dealloc( PoolManager.alloc( bytes ) );
+        }
+        UT_COMMENT( pool_count << " pool(s):\t" << timer.getElapsed() <<
+            " ms\n" );
+    }
+
+    UT_COMMENT( "Checking that pool ids are reused after removal\n" );
+    MemPoolManager PoolManager;
+    MemoryPool* pool_32_ptr = new MemoryPool( 32, 10 );
+    MemoryPool* pool_64_ptr = new MemoryPool( 64, 10 );
+    MemoryPool* pool_16_ptr = new MemoryPool( 16, 10 );
+    UT_CHECK_OUTPUT( PoolManager.addPool( pool_32_ptr ) == true );
+    UT_CHECK_OUTPUT( PoolManager.addPool( pool_64_ptr ) == true );
+    UT_CHECK_OUTPUT( PoolManager.addPool( pool_16_ptr ) == true );
+    UT_CHECK_OUTPUT( pool_32_ptr->getPoolId() == 0 );
+    UT_CHECK_OUTPUT( pool_64_ptr->getPoolId() == 1 );
+    UT_CHECK_OUTPUT( pool_16_ptr->getPoolId() == 2 );
+    UT_CHECK_OUTPUT( PoolManager.removePool( 1 ) == true );
+    MemoryPool* pool_128_ptr = new MemoryPool( 128, 10 );
+    UT_CHECK_OUTPUT( PoolManager.addPool( pool_128_ptr ) == true );
+    UT_CHECK_OUTPUT( pool_128_ptr->getPoolId() == 1 );
+
+    void* ptr = PoolManager.alloc( 100 );
+    UT_CHECK_OUTPUT( pool_128_ptr->getFreeBlockCount() == 9 );
+    PoolManager.dealloc( ptr );
+    UT_CHECK_OUTPUT( pool_128_ptr->getFreeBlockCount() == 10 );
+    UT_CHECK_OUTPUT( PoolManager.getPoolCount() == 3 );
+
+    UT_COMMENT( "Pools added in descending block size order\n" );
+    {
+        MemPoolManager DescendingManager;
+        MemoryPool* pool_d64_ptr = new MemoryPool( 64, 10 );
+        MemoryPool* pool_d32_ptr = new MemoryPool( 32, 10 );
+        MemoryPool* pool_d16_ptr = new MemoryPool( 16, 10 );
+        UT_CHECK_OUTPUT( DescendingManager.addPool( pool_d64_ptr ) == true );
+        UT_CHECK_OUTPUT( DescendingManager.addPool( pool_d32_ptr ) == true );
+        UT_CHECK_OUTPUT( DescendingManager.addPool( pool_d16_ptr ) == true );
+        UT_CHECK_OUTPUT( DescendingManager.getPoolCount() == 3 );
+        void* ptr_16 = DescendingManager.alloc( 16 );
+        void* ptr_32 = DescendingManager.alloc( 32 );
+        UT_CHECK_OUTPUT( pool_d16_ptr->getFreeBlockCount() == 9 );
+        UT_CHECK_OUTPUT( pool_d32_ptr->getFreeBlockCount() == 9 );
+        UT_CHECK_OUTPUT( pool_d64_ptr->getFreeBlockCount() == 10 );
+        DescendingManager.dealloc( ptr_16 );
+        DescendingManager.dealloc( ptr_32 );
+        // The smallest pool is in the list, so removal finds it
+        UT_CHECK_OUTPUT( DescendingManager.removePoolByBlockSize( 16 ) == true );
+        UT_CHECK_OUTPUT( DescendingManager.getPoolCount() == 2 );
+        // The manager destroys the other two pools
+    }
+
+    UT_COMMENT( "A pool that can not grow falls through to a larger one\n" );
+    {
+        // Growing by 2^26 blocks of 1 MB can never be allocated
+        MemPoolConfigStr huge_config;
+        huge_config.growth = MemPoolConfigStr::GROWTH_FIXED;
+        huge_config.growth_blocks = 1 << 26;
+        for( int caching = 0; caching < 2; caching++ ) {
+            MemPoolManager GrowthManager;
+            MemoryPool* pool_huge_ptr = new MemoryPool( 1 << 20, 1, huge_config );
+            MemoryPool* pool_large_ptr = new MemoryPool( 2 << 20, 1 );
+            GrowthManager.addPool( pool_huge_ptr );
+            GrowthManager.addPool( pool_large_ptr );
+            GrowthManager.setThreadCaching( caching == 1 );
+            void* first_ptr = GrowthManager.alloc( 1 << 20 );
+            void* second_ptr = GrowthManager.alloc( 1 << 20 );
+            UT_CHECK_OUTPUT( first_ptr != NULL && second_ptr != NULL );
+            UT_CHECK_OUTPUT( pool_large_ptr->getFreeBlockCount() == 0 );
+            MemPoolStatsStr stats;
+            GrowthManager.getStats( stats );
+            UT_CHECK_OUTPUT( stats.failed_allocs == 0 && stats.fallthroughs == 1 );
+            GrowthManager.dealloc( first_ptr );
+            GrowthManager.dealloc( second_ptr );
+            GrowthManager.setThreadCaching( false );
+        }
+    }
+
+    UT_END_STEP;
+
+/* ------------------------------
+   TC step 10
+
+   MemoryPool: growth policies
+   ------------------------------ */
+
+    UT_START_STEP( 10 );
+
+    void* ptr_array[ 100 ];
+
+    UT_COMMENT( "Fixed growth: 10 blocks + 3 chunks of 20 blocks, cap 70\n" );
+    MemPoolConfigStr config;
+    config.growth = MemPoolConfigStr::GROWTH_FIXED;
+    config.growth_blocks = 20;
+    config.max_block_count = 70;
+    MemoryPool FixedPool( 32, 10, config );
+    UT_CHECK_OUTPUT( FixedPool.getBlockCount() == 10 );
+    UT_CHECK_OUTPUT( FixedPool.getChunkCount() == 1 );
+    for( uint32_t i = 0; i < 70; i++ ) {
+        ptr_array[ i ] = FixedPool.alloc();
+        UT_CHECK_OUTPUT( ptr_array[ i ] != NULL );
+    }
+    UT_CHECK_OUTPUT( FixedPool.getBlockCount() == 70 );
+    UT_CHECK_OUTPUT( FixedPool.getChunkCount() == 4 );
+    UT_CHECK_OUTPUT( FixedPool.getFreeBlockCount() == 0 );
+    UT_CHECK_OUTPUT( FixedPool.isExhausted() == true );
+    for( uint32_t i = 0; i < 70; i++ ) {
+        FixedPool.dealloc( ptr_array[ i ] );
+    }
+    UT_CHECK_OUTPUT( FixedPool.getFreeBlockCount() == 70 );
+    UT_CHECK_OUTPUT( FixedPool.isExhausted() == false );
+
+    UT_COMMENT( "Geometric growth: 8, 16, 32, 64 blocks, cap 100\n" );
+    config.growth = MemPoolConfigStr::GROWTH_GEOMETRIC;
+    config.max_block_count = 100;
+    MemoryPool GeometricPool( 32, 8, config );
+    for( uint32_t i = 0; i < 100; i++ ) {
+        ptr_array[ i ] = GeometricPool.alloc();
+        if( i == 8 ) UT_CHECK_OUTPUT( GeometricPool.getBlockCount() == 16 );
+        if( i == 16 ) UT_CHECK_OUTPUT( GeometricPool.getBlockCount() == 32 );
+        if( i == 32 ) UT_CHECK_OUTPUT( GeometricPool.getBlockCount() == 64 );
+    }
+    UT_CHECK_OUTPUT( ptr_array[ 99 ] != NULL );
+    UT_CHECK_OUTPUT( GeometricPool.getBlockCount() == 100 );
+    UT_CHECK_OUTPUT( GeometricPool.getChunkCount() == 5 );
+    UT_CHECK_OUTPUT( GeometricPool.isExhausted() == true );
+    for( uint32_t i = 0; i < 100; i++ ) {
+        GeometricPool.dealloc( ptr_array[ i ] );
+    }
+    UT_CHECK_OUTPUT( GeometricPool.getFreeBlockCount() == 100 );
+
+    UT_COMMENT( "Failed growth does not change the capacity\n" );
+    {
+        // Growing by 2^26 blocks of 1 MB can never be allocated
+        MemPoolConfigStr huge_config;
+        huge_config.growth = MemPoolConfigStr::GROWTH_FIXED;
+        huge_config.growth_blocks = 1 << 26;
+        MemoryPool HugeGrowthPool( 1 << 20, 1, huge_config );
+        void* huge_array[ 2 ];
+        UT_CHECK_OUTPUT( HugeGrowthPool.allocBatch( huge_array, 1 ) == 1 );
+        UT_CHECK_OUTPUT( HugeGrowthPool.isExhausted() == false );
+        // alloc() asserts on failure, allocBatch() reports it
+        UT_CHECK_OUTPUT( HugeGrowthPool.allocBatch( huge_array + 1, 1 ) == 0 );
+        UT_CHECK_OUTPUT( HugeGrowthPool.getBlockCount() == 1 );
+        UT_CHECK_OUTPUT( HugeGrowthPool.getChunkCount() == 1 );
+        UT_CHECK_OUTPUT( HugeGrowthPool.getFreeBlockCount() == 0 );
+        UT_CHECK_OUTPUT( HugeGrowthPool.isExhausted() == true );
+        HugeGrowthPool.deallocBatch( huge_array, 1 );
+        UT_CHECK_OUTPUT( HugeGrowthPool.isExhausted() == false );
+        UT_CHECK_OUTPUT( HugeGrowthPool.getFreeBlockCount() == 1 );
+    }
+
+    UT_COMMENT( "Growing pool in a manager does not fall through\n" );
+    MemPoolManager PoolManager;
+    config.growth = MemPoolConfigStr::GROWTH_FIXED;
+    config.growth_blocks = 0;
+    config.max_block_count = 0;
+    MemoryPool* pool_32_ptr = new MemoryPool( 32, 10, config );
+    MemoryPool* pool_64_ptr = new MemoryPool( 64, 10 );
+    UT_CHECK_OUTPUT( PoolManager.addPool( pool_32_ptr ) == true );
+    UT_CHECK_OUTPUT( PoolManager.addPool( pool_64_ptr ) == true );
+    for( uint32_t i = 0; i < 25; i++ ) {
+        ptr_array[ i ] = PoolManager.alloc( 32 );
+    }
+    UT_CHECK_OUTPUT( pool_32_ptr->getBlockCount() == 30 );
+    UT_CHECK_OUTPUT( pool_32_ptr->getFreeBlockCount() == 5 );
+    UT_CHECK_OUTPUT( pool_64_ptr->getFreeBlockCount() == 10 );
+    for( uint32_t i = 0; i < 25; i++ ) {
+        PoolManager.dealloc( ptr_array[ i ] );
+    }
+    UT_CHECK_OUTPUT( pool_32_ptr->getFreeBlockCount() == 30 );
+
+    UT_END_STEP;
+
+/* ------------------------------
+   TC step 11
+
+   MemoryPool: lazy carving of
+   never used blocks
+   ------------------------------ */
+
+    UT_START_STEP( 11 );
+
+    uint32_t block_size = 1024;
+    uint32_t block_count = 100000;
+
+    UT_COMMENT( "Creating and destroying 100 pools of " << block_count <<
+        " x " << block_size << " bytes\n" );
+    Timer timer = Timer();
+    for( uint32_t i = 0; i < 100; i++ ) {
+        MemoryPool* pool_ptr = new MemoryPool( block_size, block_count );
+        delete pool_ptr;
+    }
+    UT_COMMENT( "Total time:\t" << timer.getElapsed() << " ms\n" );
+
+    MemoryPool MemPool( block_size, block_count );
+    UT_CHECK_OUTPUT( MemPool.getFreeBlockCount() == block_count );
+
+    // Never used blocks are handed out in address order
+    uint8_t* first_ptr = ( uint8_t* )MemPool.alloc();
+    uint8_t* second_ptr = ( uint8_t* )MemPool.alloc();
+    UT_CHECK_OUTPUT( first_ptr ==
+        ( uint8_t* )MemPool.getPoolPtr() + SIZE_MEM_BLOCK_HEADER );
+    UT_CHECK_OUTPUT( second_ptr ==
+        first_ptr + SIZE_MEM_BLOCK_HEADER + block_size );
+    UT_CHECK_OUTPUT( MemPool.getFreeBlockCount() == block_count - 2 );
+
+    // Recycled blocks are used before carving new ones
+    MemPool.dealloc( first_ptr );
+    UT_CHECK_OUTPUT( MemPool.getFreeBlockCount() == block_count - 1 );
+    UT_CHECK_OUTPUT( MemPool.alloc() == first_ptr );
+    UT_CHECK_OUTPUT( ( uint8_t* )MemPool.alloc() ==
+        second_ptr + SIZE_MEM_BLOCK_HEADER + block_size );
+
+    UT_END_STEP;
+
+/* ------------------------------
+   TC step 12
+
+   MemoryPool: aligned layout without
+   block headers
+   ------------------------------ */
+
+    UT_START_STEP( 12 );
+
+    MemPoolConfigStr config;
+    config.layout = MemPoolConfigStr::LAYOUT_ALIGNED;
+
+    UT_COMMENT( "Checking block alignment and chunk lookup\n" );
+    for( uint32_t alignment = 16; alignment <= 64; alignment *= 2 ) {
+        config.alignment = alignment;
+        MemoryPool AlignedPool( 40, 10000, config );
+        UT_CHECK_OUTPUT( AlignedPool.getBlockStride() % alignment == 0 );
+        bool all_ok = true;
+        void** ptr_array = new void*[ 10000 ];
+        for( uint32_t i = 0; i < 10000; i++ ) {
+            ptr_array[ i ] = AlignedPool.alloc();
+            if( ptr_array[ i ] == NULL ||
+                ( uintptr_t )ptr_array[ i ] % alignment != 0 ||
+                MemoryPool::getChunkPool( ptr_array[ i ] ) != &AlignedPool ) {
+                all_ok = false;
+            }
+        }
+        UT_CHECK_OUTPUT( all_ok );
+        UT_CHECK_OUTPUT( AlignedPool.getChunkCount() > 1 );
+        for( uint32_t i = 0; i < 10000; i += 2 ) {
+            AlignedPool.dealloc( ptr_array[ i ] );
+        }
+        UT_CHECK_OUTPUT( AlignedPool.getFreeBlockCount() == 5000 );
+        delete[] ptr_array;
+    }
+
+    UT_COMMENT( "MemPoolManager with aligned pools\n" );
+    MemPoolManager PoolManager( MemPoolConfigStr::LAYOUT_ALIGNED );
+    config.alignment = 64;
+    MemoryPool* pool_64_ptr = new MemoryPool( 64, 100, config );
+    MemoryPool* pool_128_ptr = new MemoryPool( 128, 100, config );
+    MemoryPool* header_pool_ptr = new MemoryPool( 256, 100 );
+    UT_CHECK_OUTPUT( PoolManager.addPool( pool_64_ptr ) == true );
+    UT_CHECK_OUTPUT( PoolManager.addPool( pool_128_ptr ) == true );
+    UT_CHECK_OUTPUT( PoolManager.addPool( header_pool_ptr ) == false );
+    delete header_pool_ptr;
+
+    void* ptr_64 = PoolManager.alloc( 64 );
+    void* ptr_128 = PoolManager.alloc( 100 );
+    UT_CHECK_OUTPUT( pool_64_ptr->getFreeBlockCount() == 99 );
+    UT_CHECK_OUTPUT( pool_128_ptr->getFreeBlockCount() == 99 );
+    PoolManager.dealloc( ptr_128 );
+    UT_CHECK_OUTPUT( pool_128_ptr->getFreeBlockCount() == 100 );
+    PoolManager.dealloc( ptr_64 );
+    UT_CHECK_OUTPUT( pool_64_ptr->getFreeBlockCount() == 100 );
+
+    // Matrix sized payloads: header layout vs cache line aligned layout
+    uint32_t block_count = 100000;
+    uint32_t rounds = 20;
+    UT_COMMENT( rounds << " passes over " << block_count <<
+        " pooled 4x4 float matrices:\n" );
+    MemoryPool HeaderPool( 64, block_count );
+    MemoryPool AlignedPool( 64, block_count, config );
+    float** mat_array = new float*[ block_count ];
+    MemoryPool* bench_pools[ 2 ] = { &HeaderPool, &AlignedPool };
+    const char* bench_names[ 2 ] = { "header layout", "aligned layout" };
+    for( uint32_t p = 0; p < 2; p++ ) {
+        for( uint32_t i = 0; i < block_count; i++ ) {
+            mat_array[ i ] = ( float* )bench_pools[ p ]->alloc();
+            for( uint32_t k = 0; k < 16; k++ ) mat_array[ i ][ k ] = ( float )k;
+        }
+        float sum = 0.0f;
+        Timer timer = Timer();
+        for( uint32_t r = 0; r < rounds; r++ ) {
+            for( uint32_t i = 0; i < block_count; i++ ) {
+                float* m = mat_array[ i ];
+                for( uint32_t k = 0; k < 16; k++ ) sum += m[ k ];
+            }
+        }
+        UT_COMMENT( bench_names[ p ] << ":\t" << timer.getElapsed() <<
+            " ms (checksum " << sum << ")\n" );
+        for( uint32_t i = 0; i < block_count; i++ ) {
+            bench_pools[ p ]->dealloc( mat_array[ i ] );
+        }
+    }
+    delete[] mat_array;
+
+    UT_END_STEP;
+
+/* ------------------------------
+   TC step 13
+
+   MemoryPool: mmap and huge page
+   backed chunks, prefaulting
+   ------------------------------ */
+
+    UT_START_STEP( 13 );
+
+    MemPoolConfigStr::BackingEnum backings[ 3 ] = {
+        MemPoolConfigStr::BACKING_MALLOC,
+        MemPoolConfigStr::BACKING_MMAP,
+        MemPoolConfigStr::BACKING_HUGE_PAGES };
+    const char* backing_names[ 3 ] = { "malloc", "mmap", "huge pages" };
+
+    UT_COMMENT( "Checking all backings with both layouts\n" );
+    for( uint32_t b = 0; b < 3; b++ ) {
+        for( uint32_t l = 0; l < 2; l++ ) {
+            MemPoolConfigStr backing_config;
+            backing_config.backing = backings[ b ];
+            backing_config.prefault = ( l == 0 );
+            backing_config.growth = MemPoolConfigStr::GROWTH_FIXED;
+            backing_config.growth_blocks = 1000;
+            backing_config.max_block_count = 20000;
+            if( l == 1 ) {
+                backing_config.layout = MemPoolConfigStr::LAYOUT_ALIGNED;
+            }
+            MemoryPool BackedPool( 48, 10000, backing_config );
+            void** ptr_array = new void*[ 20000 ];
+            bool all_ok = true;
+            for( uint32_t i = 0; i < 20000; i++ ) {
+                ptr_array[ i ] = BackedPool.alloc();
+                if( ptr_array[ i ] == NULL ) {
+                    all_ok = false;
+                    break;
+                }
+                memset( ptr_array[ i ], ( int )i, 48 );
+            }
+            UT_CHECK_OUTPUT( all_ok );
+            UT_CHECK_OUTPUT( BackedPool.isExhausted() == true );
+            UT_CHECK_OUTPUT( BackedPool.getFreeBlockCount() == 0 );
+            for( uint32_t i = 0; i < 20000 && all_ok; i++ ) {
+                BackedPool.dealloc( ptr_array[ i ] );
+            }
+            UT_CHECK_OUTPUT( BackedPool.getFreeBlockCount() == 20000 );
+            delete[] ptr_array;
+        }
+    }
+
+    // Large pool walked in a scattered order, so that TLB reach matters
+    uint32_t big_count = 400000;
+    uint32_t big_rounds = 10;
+    UT_COMMENT( big_rounds << " scattered passes over " << big_count <<
+        " 64 byte blocks (first pass includes page faults):\n" );
+    uint64_t** big_array = new uint64_t*[ big_count ];
+    for( uint32_t b = 0; b < 3; b++ ) {
+        for( uint32_t f = 0; f < 2; f++ ) {
+            MemPoolConfigStr backing_config;
+            backing_config.backing = backings[ b ];
+            backing_config.prefault = ( f == 1 );
+            Timer timer = Timer();
+            MemoryPool BigPool( 64, big_count, backing_config );
+            uint32_t construct_time = timer.getElapsed();
+            for( uint32_t i = 0; i < big_count; i++ ) {
+                big_array[ i ] = ( uint64_t* )BigPool.alloc();
+            }
+            timer = Timer();
+            uint64_t sum = 0;
+            uint32_t first_pass_time = 0;
+            for( uint32_t r = 0; r < big_rounds; r++ ) {
+                for( uint32_t i = 0; i < big_count; i++ ) {
+                    uint64_t* p = big_array[ ( i * 7919 ) % big_count ];
+                    p[ 0 ] += i;
+                    sum += p[ 0 ];
+                }
+                if( r == 0 ) {
+                    first_pass_time = timer.getElapsed();
+                }
+            }
+            UT_COMMENT( backing_names[ b ] <<
+                ( f == 1 ? ", prefault" : "" ) << ":\tconstruct " <<
+                construct_time << " ms, first pass " << first_pass_time <<
+                " ms, total " << timer.getElapsed() << " ms (checksum " <<
+                ( uint32_t )sum << ")\n" );
+            for( uint32_t i = 0; i < big_count; i++ ) {
+                BigPool.dealloc( big_array[ i ] );
+            }
+        }
+    }
+    delete[] big_array;
+
+    UT_END_STEP;
+
+/* ------------------------------
+   TC step 14
+
+   MemoryPool and MemPoolManager:
+   batch allocation and free
+   ------------------------------ */
+
+    UT_START_STEP( 14 );
+
+    UT_COMMENT( "Batches from the free list, bump region and growth\n" );
+    MemPoolConfigStr batch_config;
+    batch_config.growth = MemPoolConfigStr::GROWTH_FIXED;
+    batch_config.growth_blocks = 100;
+    batch_config.max_block_count = 300;
+    MemoryPool BatchPool( 32, 100, batch_config );
+    void* batch_array[ 400 ];
+    UT_CHECK_OUTPUT( BatchPool.allocBatch( batch_array, 50 ) == 50 );
+    BatchPool.deallocBatch( batch_array, 20 );
+    UT_CHECK_OUTPUT( BatchPool.getFreeBlockCount() == 70 );
+    // 20 from the free list, 50 carved, 180 after growing twice
+    UT_CHECK_OUTPUT( BatchPool.allocBatch( batch_array + 50, 250 ) == 250 );
+    UT_CHECK_OUTPUT( BatchPool.getChunkCount() == 3 );
+    UT_CHECK_OUTPUT( BatchPool.allocBatch( batch_array + 300, 100 ) == 20 );
+    UT_CHECK_OUTPUT( BatchPool.isExhausted() == true );
+    // Blocks 20..319 of the array are now in use
+    bool batch_ok = true;
+    for( uint32_t i = 20; i < 320; i++ ) {
+        memset( batch_array[ i ], 0xab, 32 );
+        for( uint32_t k = 20; k < i; k++ ) {
+            if( batch_array[ k ] == batch_array[ i ] ) batch_ok = false;
+        }
+    }
+    UT_CHECK_OUTPUT( batch_ok );
+    BatchPool.deallocBatch( batch_array + 20, 300 );
+    UT_CHECK_OUTPUT( BatchPool.getFreeBlockCount() == 300 );
+    // First block of the freed batch is handed out first
+    UT_CHECK_OUTPUT( BatchPool.alloc() == batch_array[ 20 ] );
+    BatchPool.dealloc( batch_array[ 20 ] );
+
+    UT_COMMENT( "Manager batches spill to larger pools\n" );
+    MemPoolManager BatchManager;
+    MemoryPool* small_pool_ptr = new MemoryPool( 16, 100 );
+    MemoryPool* large_pool_ptr = new MemoryPool( 64, 100 );
+    BatchManager.addPool( small_pool_ptr );
+    BatchManager.addPool( large_pool_ptr );
+    UT_CHECK_OUTPUT( BatchManager.allocBatch( 12, 150, batch_array ) == 150 );
+    UT_CHECK_OUTPUT( small_pool_ptr->getFreeBlockCount() == 0 );
+    UT_CHECK_OUTPUT( large_pool_ptr->getFreeBlockCount() == 50 );
+    UT_CHECK_OUTPUT( BatchManager.allocBatch( 12, 100, batch_array + 150 ) == 50 );
+    BatchManager.deallocBatch( batch_array, 200 );
+    UT_CHECK_OUTPUT( small_pool_ptr->getFreeBlockCount() == 100 );
+    UT_CHECK_OUTPUT( large_pool_ptr->getFreeBlockCount() == 100 );
+
+    // Batches vs single block loops through the manager
+    uint32_t batch_rounds = 20000;
+    const uint32_t batch_size = 256;
+    MemPoolManager BenchManager;
+    for( uint32_t size = 16; size <= 256; size *= 2 ) {
+        BenchManager.addPool( new MemoryPool( size, batch_size ) );
+    }
+    void* bench_array[ batch_size ];
+    UT_COMMENT( batch_rounds << " rounds of " << batch_size <<
+        " allocs and frees of 100 bytes:\n" );
+    Timer timer = Timer();
+    for( uint32_t r = 0; r < batch_rounds; r++ ) {
+        for( uint32_t i = 0; i < batch_size; i++ ) {
+            bench_array[ i ] = BenchManager.alloc( 100 );
+        }
+        for( uint32_t i = 0; i < batch_size; i++ ) {
+            BenchManager.dealloc( bench_array[ i ] );
+        }
+    }
+    UT_COMMENT( "single block loops:\t" << timer.getElapsed() << " ms\n" );
+    timer = Timer();
+    for( uint32_t r = 0; r < batch_rounds; r++ ) {
+        BenchManager.allocBatch( 100, batch_size, bench_array );
+        BenchManager.deallocBatch( bench_array, batch_size );
+    }
+    UT_COMMENT( "allocBatch/deallocBatch:\t" << timer.getElapsed() << " ms\n" );
+
+    UT_END_STEP;
+
+/* ------------------------------
+   TC step 15
+
+   FrameArena: per-frame linear
+   allocation, double buffering
+   ------------------------------ */
+
+    UT_START_STEP( 15 );
+
+    UT_COMMENT( "Alignment, capacity and reset\n" );
+    FrameArena Arena( 1024 );
+    void* arena_ptr_1 = Arena.alloc( 3, 1 );
+    void* arena_ptr_2 = Arena.alloc( 64, 64 );
+    void* arena_ptr_3 = Arena.alloc( 8 );
+    UT_CHECK_OUTPUT( arena_ptr_1 != NULL && arena_ptr_2 != NULL && arena_ptr_3 != NULL );
+    UT_CHECK_OUTPUT( ( uintptr_t )arena_ptr_2 % 64 == 0 );
+    UT_CHECK_OUTPUT( ( uintptr_t )arena_ptr_3 % 16 == 0 );
+    UT_CHECK_OUTPUT( ( uint8_t* )arena_ptr_3 >= ( uint8_t* )arena_ptr_2 + 64 );
+    UT_CHECK_OUTPUT( Arena.contains( arena_ptr_3 ) == true );
+    UT_CHECK_OUTPUT( Arena.alloc( 2048 ) == NULL );
+    uint32_t used_bytes = Arena.getUsedBytes();
+    Arena.reset();
+    UT_CHECK_OUTPUT( Arena.getUsedBytes() == 0 );
+    UT_CHECK_OUTPUT( Arena.getPeakUsage() == used_bytes );
+    UT_CHECK_OUTPUT( Arena.alloc( 3, 1 ) == arena_ptr_1 );
+
+    UT_COMMENT( "Previous frame stays intact in a double buffered arena\n" );
+    FrameArena DoubleArena( 4096, true );
+    uint32_t* frame_data = NULL;
+    uint32_t* prev_frame_data = NULL;
+    bool frames_ok = true;
+    for( uint32_t frame = 0; frame < 10; frame++ ) {
+        frame_data = ( uint32_t* )DoubleArena.alloc( 256 * sizeof( uint32_t ) );
+        for( uint32_t i = 0; i < 256; i++ ) frame_data[ i ] = frame;
+        if( prev_frame_data != NULL ) {
+            // "Render thread" reads the previous frame
+            for( uint32_t i = 0; i < 256; i++ ) {
+                if( prev_frame_data[ i ] != frame - 1 ) frames_ok = false;
+            }
+            if( prev_frame_data == frame_data ) frames_ok = false;
+        }
+        prev_frame_data = frame_data;
+        DoubleArena.swap();
+    }
+    UT_CHECK_OUTPUT( frames_ok );
+
+    // Scratch allocations of one frame: arena vs pool manager vs malloc
+    uint32_t frame_count = 200;
+    uint32_t frame_allocs = 20000;
+    UT_COMMENT( frame_count << " frames of " << frame_allocs <<
+        " scratch allocations of 16..128 bytes:\n" );
+    void** scratch_array = new void*[ frame_allocs ];
+    FrameArena ScratchArena( frame_allocs * 144 );
+    Timer timer = Timer();
+    for( uint32_t frame = 0; frame < frame_count; frame++ ) {
+        for( uint32_t i = 0; i < frame_allocs; i++ ) {
+            scratch_array[ i ] = ScratchArena.alloc( 16 + ( i & 7 ) * 16 );
+        }
+        ScratchArena.reset();
+    }
+    UT_COMMENT( "FrameArena:\t" << timer.getElapsed() << " ms\n" );
+
+    MemPoolManager ScratchManager;
+    for( uint32_t size = 16; size <= 128; size += 16 ) {
+        ScratchManager.addPool( new MemoryPool( size, frame_allocs / 8 ) );
+    }
+    timer = Timer();
+    for( uint32_t frame = 0; frame < frame_count; frame++ ) {
+        for( uint32_t i = 0; i < frame_allocs; i++ ) {
+            scratch_array[ i ] = ScratchManager.alloc( 16 + ( i & 7 ) * 16 );
+        }
+        for( uint32_t i = 0; i < frame_allocs; i++ ) {
+            ScratchManager.dealloc( scratch_array[ i ] );
+        }
+    }
+    UT_COMMENT( "MemPoolManager:\t" << timer.getElapsed() << " ms\n" );
+
+    timer = Timer();
+    for( uint32_t frame = 0; frame < frame_count; frame++ ) {
+        for( uint32_t i = 0; i < frame_allocs; i++ ) {
+            scratch_array[ i ] = malloc( 16 + ( i & 7 ) * 16 );
+        }
+        for( uint32_t i = 0; i < frame_allocs; i++ ) {
+            free( scratch_array[ i ] );
+        }
+    }
+    UT_COMMENT( "malloc/free:\t" << timer.getElapsed() << " ms\n" );
+    delete[] scratch_array;
+
+    UT_END_STEP;
+
+/* ------------------------------
+   TC step 16
+
+   StackAllocator: markers, nested
+   scopes and double-ended use
+   ------------------------------ */
+
+    UT_START_STEP( 16 );
+
+    UT_COMMENT( "Markers and nested scopes\n" );
+    StackAllocator Stack( 4096 );
+    void* level_ptr = Stack.alloc( 100 );
+    StackAllocator::Marker level_marker = Stack.getMarker();
+    {
+        StackScope outer_scope( Stack );
+        void* tmp_ptr_1 = Stack.alloc( 500 );
+        {
+            StackScope inner_scope( Stack );
+            void* tmp_ptr_2 = Stack.alloc( 1000, 64 );
+            UT_CHECK_OUTPUT( tmp_ptr_2 > tmp_ptr_1 );
+            UT_CHECK_OUTPUT( ( uintptr_t )tmp_ptr_2 % 64 == 0 );
+        }
+        // Inner scope released its block, the next one reuses the space
+        void* tmp_ptr_3 = Stack.alloc( 8 );
+        UT_CHECK_OUTPUT( tmp_ptr_3 > tmp_ptr_1 &&
+            ( uint8_t* )tmp_ptr_3 < ( uint8_t* )tmp_ptr_1 + 600 );
+    }
+    UT_CHECK_OUTPUT( Stack.getMarker() == level_marker );
+    UT_CHECK_OUTPUT( Stack.alloc( 8192 ) == NULL );
+    UT_CHECK_OUTPUT( Stack.getMarker() == level_marker );
+
+    UT_COMMENT( "Double-ended allocation\n" );
+    StackAllocator::Marker top_marker = Stack.getTopMarker();
+    void* top_ptr = Stack.allocTop( 1000, 32 );
+    UT_CHECK_OUTPUT( top_ptr != NULL && ( uintptr_t )top_ptr % 32 == 0 );
+    UT_CHECK_OUTPUT( ( uint8_t* )top_ptr > ( uint8_t* )level_ptr + 100 );
+    UT_CHECK_OUTPUT( Stack.getFreeBytes() <= 4096 - 1100 );
+    // The ends must not overlap
+    UT_CHECK_OUTPUT( Stack.alloc( 3000 ) == NULL );
+    UT_CHECK_OUTPUT( Stack.allocTop( 3000 ) == NULL );
+    UT_CHECK_OUTPUT( Stack.alloc( 2000 ) != NULL );
+    Stack.freeToMarker( level_marker );
+    Stack.freeToTopMarker( top_marker );
+    UT_CHECK_OUTPUT( Stack.getFreeBytes() == 4096 - level_marker );
+    Stack.clear();
+    UT_CHECK_OUTPUT( Stack.getFreeBytes() == 4096 );
+
+    // A load path: nested phases allocating variable sized temporaries
+    uint32_t load_count = 2000;
+    uint32_t phase_allocs = 200;
+    UT_COMMENT( load_count << " loads of 4 phases with " << phase_allocs <<
+        " temporaries of 16..4096 bytes each:\n" );
+    StackAllocator LoadStack( 4 * phase_allocs * 4112 );
+    char** tmp_array = new char*[ 4 * phase_allocs ];
+    uint32_t checksum = 0;
+    Timer timer = Timer();
+    for( uint32_t l = 0; l < load_count; l++ ) {
+        StackAllocator::Marker marker = LoadStack.getMarker();
+        for( uint32_t p = 0; p < 4; p++ ) {
+            for( uint32_t i = 0; i < phase_allocs; i++ ) {
+                char* tmp_ptr = ( char* )LoadStack.alloc( 16 + ( ( i * 37 ) & 4095 ), 1 );
+                tmp_ptr[ 0 ] = ( char )i;
+                checksum += tmp_ptr[ 0 ];
+            }
+        }
+        LoadStack.freeToMarker( marker );
+    }
+    UT_COMMENT( "StackAllocator:\t" << timer.getElapsed() << " ms (checksum " <<
+        checksum << ")\n" );
+    checksum = 0;
+    timer = Timer();
+    for( uint32_t l = 0; l < load_count; l++ ) {
+        uint32_t count = 0;
+        for( uint32_t p = 0; p < 4; p++ ) {
+            for( uint32_t i = 0; i < phase_allocs; i++ ) {
+                char* tmp_ptr = new char[ 16 + ( ( i * 37 ) & 4095 ) ];
+                tmp_ptr[ 0 ] = ( char )i;
+                checksum += tmp_ptr[ 0 ];
+                tmp_array[ count++ ] = tmp_ptr;
+            }
+        }
+        while( count > 0 ) {
+            delete[] tmp_array[ --count ];
+        }
+    }
+    UT_COMMENT( "new[]/delete[]:\t" << timer.getElapsed() << " ms (checksum " <<
+        checksum << ")\n" );
+    delete[] tmp_array;
+
+    UT_END_STEP;
+
+/* ------------------------------
+   TC step 17
+
+   PoolAllocator: standard containers
+   on top of MemPoolManager
+   ------------------------------ */
+
+    UT_START_STEP( 17 );
+
+    MemPoolConfigStr stl_config;
+    stl_config.growth = MemPoolConfigStr::GROWTH_GEOMETRIC;
+    MemPoolManager ListManager;
+    MemPoolManager MapManager;
+    MemoryPool* stl_pools[ 8 ];
+    for( uint32_t i = 0; i < 4; i++ ) {
+        stl_pools[ i ] = new MemoryPool( 16 << i, 1024, stl_config );
+        stl_pools[ i + 4 ] = new MemoryPool( 16 << i, 1024, stl_config );
+        ListManager.addPool( stl_pools[ i ] );
+        MapManager.addPool( stl_pools[ i + 4 ] );
+    }
+
+    UT_COMMENT( "Containers with their own managers\n" );
+    {
+        typedef std::list< int, PoolAllocator< int > > PoolIntList;
+        typedef std::map< int, int, std::less< int >,
+            PoolAllocator< std::pair< const int, int > > > PoolIntMap;
+        PoolIntList list( ( PoolAllocator< int >( &ListManager ) ) );
+        PoolIntMap map( ( std::less< int >() ),
+            PoolAllocator< std::pair< const int, int > >( &MapManager ) );
+        for( int i = 0; i < 5000; i++ ) {
+            list.push_back( i );
+            map[ i ] = i * 2;
+        }
+        bool containers_ok = true;
+        int i = 0;
+        for( PoolIntList::iterator it = list.begin(); it != list.end(); ++it ) {
+            if( *it != i++ ) containers_ok = false;
+        }
+        for( i = 0; i < 5000; i++ ) {
+            if( map[ i ] != i * 2 ) containers_ok = false;
+        }
+        UT_CHECK_OUTPUT( containers_ok );
+        UT_CHECK_OUTPUT( list.get_allocator().getManager() == &ListManager );
+        UT_CHECK_OUTPUT( map.get_allocator().getManager() == &MapManager );
+
+        // Larger than any pool: falls back to malloc
+        std::vector< int, PoolAllocator< int > > vec(
+            ( PoolAllocator< int >( &ListManager ) ) );
+        vec.resize( 10000, 7 );
+        UT_CHECK_OUTPUT( vec[ 9999 ] == 7 );
+
+        PoolIntList list_copy( list );
+        UT_CHECK_OUTPUT( list_copy.size() == 5000 );
+        UT_CHECK_OUTPUT( list_copy.get_allocator() == list.get_allocator() );
+    }
+    UT_COMMENT( "Everything is returned to the pools\n" );
+    bool all_free = true;
+    for( uint32_t i = 0; i < 8; i++ ) {
+        if( stl_pools[ i ]->getFreeBlockCount() != stl_pools[ i ]->getBlockCount() ) {
+            all_free = false;
+        }
+    }
+    UT_CHECK_OUTPUT( all_free );
+
+    uint32_t stl_count = 200000;
+    UT_COMMENT( stl_count << " inserts and erases:\n" );
+    {
+        Timer timer = Timer();
+        std::list< int > list;
+        for( uint32_t i = 0; i < stl_count; i++ ) list.push_back( i );
+        while( !list.empty() ) list.pop_front();
+        UT_COMMENT( "std::list, std::allocator:\t" << timer.getElapsed() << " ms\n" );
+    }
+    {
+        Timer timer = Timer();
+        std::list< int, PoolAllocator< int > > list(
+            ( PoolAllocator< int >( &ListManager ) ) );
+        for( uint32_t i = 0; i < stl_count; i++ ) list.push_back( i );
+        while( !list.empty() ) list.pop_front();
+        UT_COMMENT( "std::list, PoolAllocator:\t" << timer.getElapsed() << " ms\n" );
+    }
+    {
+        Timer timer = Timer();
+        std::map< int, int > map;
+        for( uint32_t i = 0; i < stl_count; i++ ) map[ ( i * 7919 ) % stl_count ] = i;
+        for( uint32_t i = 0; i < stl_count; i++ ) map.erase( i );
+        UT_COMMENT( "std::map, std::allocator:\t" << timer.getElapsed() << " ms\n" );
+    }
+    {
+        Timer timer = Timer();
+        std::map< int, int, std::less< int >,
+            PoolAllocator< std::pair< const int, int > > > map( ( std::less< int >() ),
+            PoolAllocator< std::pair< const int, int > >( &MapManager ) );
+        for( uint32_t i = 0; i < stl_count; i++ ) map[ ( i * 7919 ) % stl_count ] = i;
+        for( uint32_t i = 0; i < stl_count; i++ ) map.erase( i );
+        UT_COMMENT( "std::map, PoolAllocator:\t" << timer.getElapsed() << " ms\n" );
+    }
+
+    UT_END_STEP;
+
+/* ------------------------------
+   TC step 18
+
+   ObjectPool: construction,
+   destruction and dense iteration
+   ------------------------------ */
+
+    UT_START_STEP( 18 );
+
+    UT_COMMENT( "create and destroy call constructors and destructors\n" );
+    {
+        ObjectPool< ParticleStr > Particles( 100 );
+        ParticleStr* particle_array[ 100 ];
+        for( uint32_t i = 0; i < 100; i++ ) {
+            particle_array[ i ] = Particles.create( i, 1.0f );
+        }
+        UT_CHECK_OUTPUT( g_ParticleCount == 100 );
+        UT_CHECK_OUTPUT( particle_array[ 99 ]->id == 99 && particle_array[ 99 ]->vel[ 2 ] == 1.0f );
+        UT_CHECK_OUTPUT( Particles.create( 100, 1.0f ) == NULL );
+        for( uint32_t i = 0; i < 100; i += 3 ) {
+            Particles.destroy( particle_array[ i ] );
+        }
+        UT_CHECK_OUTPUT( g_ParticleCount == 66 );
+        UT_CHECK_OUTPUT( Particles.getLiveCount() == 66 );
+
+        UT_COMMENT( "forEach visits live objects in address order\n" );
+        bool order_ok = true;
+        uint32_t visited = 0;
+        ParticleStr* prev_ptr = NULL;
+        Particles.forEach( [ & ]( ParticleStr& particle ) {
+            if( particle.id % 3 == 0 || &particle <= prev_ptr ) order_ok = false;
+            prev_ptr = &particle;
+            visited++;
+        } );
+        UT_CHECK_OUTPUT( order_ok && visited == 66 );
+
+        // Objects may be destroyed while iterating
+        Particles.forEach( [ & ]( ParticleStr& particle ) {
+            if( particle.id % 2 == 0 ) Particles.destroy( &particle );
+        } );
+        UT_CHECK_OUTPUT( Particles.getLiveCount() == 33 );
+        UT_CHECK_OUTPUT( Particles.create( 1000, 2.0f ) != NULL );
+    }
+    UT_COMMENT( "Destructor of the pool destroys the remaining objects\n" );
+    UT_CHECK_OUTPUT( g_ParticleCount == 0 );
+
+    UT_COMMENT( "A throwing constructor gives the block back\n" );
+    {
+        ObjectPool< ThrowingStr > Throwing( 2 );
+        UT_CHECK_OUTPUT( Throwing.create( 1 ) != NULL );
+        bool thrown = false;
+        try {
+            Throwing.create( 0 );
+        }
+        catch( uint32_t ) {
+            thrown = true;
+        }
+        UT_CHECK_OUTPUT( thrown == true );
+        UT_CHECK_OUTPUT( Throwing.getLiveCount() == 1 );
+        // The failed block is free again, so the pool still fits one more
+        UT_CHECK_OUTPUT( Throwing.create( 2 ) != NULL );
+        UT_CHECK_OUTPUT( Throwing.create( 3 ) == NULL );
+        uint32_t sum = 0;
+        Throwing.forEach( [ & ]( ThrowingStr& object ) { sum += object.value; } );
+        UT_CHECK_OUTPUT( sum == 3 );
+    }
+
+    // Update sweep over live objects: ObjectPool vs heap objects in a list
+    uint32_t particle_count = 100000;
+    uint32_t update_rounds = 100;
+    UT_COMMENT( update_rounds << " update sweeps over " << particle_count / 2 <<
+        " live particles out of " << particle_count << ":\n" );
+    {
+        ObjectPool< ParticleStr > Particles( particle_count );
+        std::list< ParticleStr* > heap_list;
+        ParticleStr** pool_array = new ParticleStr*[ particle_count ];
+        for( uint32_t i = 0; i < particle_count; i++ ) {
+            pool_array[ i ] = Particles.create( i, 1.0f );
+            heap_list.push_back( new ParticleStr( i, 1.0f ) );
+        }
+        // Kill every other particle in a scattered order
+        for( uint32_t i = 0; i < particle_count; i += 2 ) {
+            Particles.destroy( pool_array[ ( i * 7919 ) % particle_count ] );
+        }
+        uint32_t index = 0;
+        for( std::list< ParticleStr* >::iterator it = heap_list.begin();
+             it != heap_list.end(); index++ ) {
+            if( index % 2 == 0 ) {
+                delete *it;
+                it = heap_list.erase( it );
+            }
+            else {
+                ++it;
+            }
+        }
+
+        Timer timer = Timer();
+        for( uint32_t r = 0; r < update_rounds; r++ ) {
+            Particles.forEach( []( ParticleStr& particle ) { particle.update( 0.016f ); } );
+        }
+        UT_COMMENT( "ObjectPool::forEach:\t" << timer.getElapsed() << " ms\n" );
+        timer = Timer();
+        for( uint32_t r = 0; r < update_rounds; r++ ) {
+            for( std::list< ParticleStr* >::iterator it = heap_list.begin();
+                 it != heap_list.end(); ++it ) {
+                ( *it )->update( 0.016f );
+            }
+        }
+        UT_COMMENT( "std::list of new'd objects:\t" << timer.getElapsed() << " ms\n" );
+        for( std::list< ParticleStr* >::iterator it = heap_list.begin();
+             it != heap_list.end(); ++it ) {
+            delete *it;
+        }
+        delete[] pool_array;
+    }
+
+    UT_END_STEP;
+
+/* ------------------------------
+   TC step 19
+
+   MemPoolManager: allocation
+   profiling and recommended pools
+   ------------------------------ */
+
+    UT_START_STEP( 19 );
+
+    // Workload: request sizes and how many of each are alive at peak
+    const uint32_t profile_sizes[ 5 ] = { 20, 40, 100, 200, 1000 };
+    const uint32_t profile_peaks[ 5 ] = { 1000, 500, 300, 100, 10 };
+    void** profile_array = new void*[ 2000 ];
+
+    // Hand-guessed pools with generous headroom
+    MemPoolConfigStr profile_config;
+    profile_config.growth = MemPoolConfigStr::GROWTH_GEOMETRIC;
+    MemPoolManager GuessManager;
+    for( uint32_t size = 32; size <= 1024; size *= 2 ) {
+        GuessManager.addPool( new MemoryPool( size, 1024, profile_config ) );
+    }
+    UT_CHECK_OUTPUT( GuessManager.setProfiling( true ) == true );
+    for( uint32_t round = 0; round < 3; round++ ) {
+        uint32_t count = 0;
+        for( uint32_t s = 0; s < 5; s++ ) {
+            for( uint32_t i = 0; i < profile_peaks[ s ]; i++ ) {
+                profile_array[ count++ ] = GuessManager.alloc( profile_sizes[ s ] );
+            }
+        }
+        GuessManager.deallocBatch( profile_array, count );
+    }
+    GuessManager.setProfiling( false );
+
+    UT_COMMENT( "Histogram of request counts and peaks\n" );
+    UT_CHECK_OUTPUT( GuessManager.getProfiledRequests( 20 ) == 3000 );
+    UT_CHECK_OUTPUT( GuessManager.getProfiledPeak( 20 ) == 1000 );
+    UT_CHECK_OUTPUT( GuessManager.getProfiledPeak( 1000 ) == 10 );
+    UT_CHECK_OUTPUT( GuessManager.getProfiledPeak( 64 ) == 0 );
+
+    UT_COMMENT( "Recommendation with one pool per size\n" );
+    MemPoolSpecStr spec_array[ 8 ];
+    UT_CHECK_OUTPUT( GuessManager.recommendPools( spec_array, 8, 10 ) == 5 );
+    bool spec_ok = true;
+    for( uint32_t s = 0; s < 5; s++ ) {
+        if( spec_array[ s ].block_size != ( ( profile_sizes[ s ] + 7 ) & ~7u ) ||
+            spec_array[ s ].block_count != profile_peaks[ s ] * 110 / 100 ) {
+            spec_ok = false;
+        }
+    }
+    UT_CHECK_OUTPUT( spec_ok );
+
+    UT_COMMENT( "Recommendation with fewer pools than sizes\n" );
+    UT_CHECK_OUTPUT( GuessManager.recommendPools( spec_array, 3, 0 ) == 3 );
+    // Classes are merged, but every size is still covered
+    UT_CHECK_OUTPUT( spec_array[ 2 ].block_size == 1000 );
+    UT_CHECK_OUTPUT( spec_array[ 0 ].block_count + spec_array[ 1 ].block_count +
+        spec_array[ 2 ].block_count == 1910 );
+
+    UT_COMMENT( "Configuration file round trip\n" );
+    const char* config_path = "mem_pool_profile.cfg";
+    UT_CHECK_OUTPUT( GuessManager.writePoolConfig( config_path, 8 ) == true );
+    MemPoolManager TunedManager;
+    UT_CHECK_OUTPUT( TunedManager.addPoolsFromConfig( config_path ) == true );
+    UT_CHECK_OUTPUT( TunedManager.getPoolCount() == 5 );
+    remove( config_path );
+    UT_CHECK_OUTPUT( TunedManager.addPoolsFromConfig( config_path ) == false );
+
+    uint32_t count = 0;
+    bool tuned_ok = true;
+    for( uint32_t s = 0; s < 5; s++ ) {
+        for( uint32_t i = 0; i < profile_peaks[ s ]; i++ ) {
+            profile_array[ count ] = TunedManager.alloc( profile_sizes[ s ] );
+            if( profile_array[ count++ ] == NULL ) tuned_ok = false;
+        }
+    }
+    UT_CHECK_OUTPUT( tuned_ok );
+    TunedManager.deallocBatch( profile_array, count );
+
+    // Memory reserved for the workload by both configurations
+    uint64_t payload_bytes = 0;
+    uint64_t guess_bytes = 0;
+    uint64_t tuned_bytes = 0;
+    for( uint32_t s = 0; s < 5; s++ ) {
+        payload_bytes += ( uint64_t )profile_sizes[ s ] * profile_peaks[ s ];
+    }
+    GuessManager.recommendPools( spec_array, 8, 10 );
+    for( uint32_t s = 0; s < 5; s++ ) {
+        tuned_bytes += ( uint64_t )spec_array[ s ].block_size * spec_array[ s ].block_count;
+    }
+    for( uint32_t size = 32; size <= 1024; size *= 2 ) {
+        guess_bytes += ( uint64_t )size * 1024;
+    }
+    UT_COMMENT( "Peak payload " << payload_bytes << " bytes, hand-guessed pools " <<
+        guess_bytes << " bytes, recommended pools " << tuned_bytes << " bytes\n" );
+    UT_CHECK_OUTPUT( tuned_bytes < guess_bytes );
+    delete[] profile_array;
+
+    UT_END_STEP;
+
+/* ------------------------------
+   TC step 20
+
+   MemoryPool: returning idle
+   memory to the system
+   ------------------------------ */
+
+    UT_START_STEP( 20 );
+
+    void** trim_array = new void*[ 20000 ];
+    for( uint32_t l = 0; l < 2; l++ ) {
+        MemPoolConfigStr trim_config;
+        trim_config.growth = MemPoolConfigStr::GROWTH_FIXED;
+        trim_config.growth_blocks = 1000;
+        trim_config.backing = MemPoolConfigStr::BACKING_MMAP;
+        if( l == 1 ) {
+            trim_config.layout = MemPoolConfigStr::LAYOUT_ALIGNED;
+        }
+        UT_COMMENT( ( l == 0 ? "Header" : "Aligned" ) << " layout: trim after a spike\n" );
+        MemoryPool TrimPool( 200, 1000, trim_config );
+        for( uint32_t i = 0; i < 20000; i++ ) {
+            trim_array[ i ] = TrimPool.alloc();
+        }
+        uint32_t spike_chunks = TrimPool.getChunkCount();
+        UT_CHECK_OUTPUT( TrimPool.getUsedBlockCount() == 20000 );
+        // Keep one block alive in the middle of the spike
+        for( uint32_t i = 0; i < 20000; i++ ) {
+            if( i != 10000 ) TrimPool.dealloc( trim_array[ i ] );
+        }
+        UT_CHECK_OUTPUT( TrimPool.trim() > 0 );
+        UT_CHECK_OUTPUT( TrimPool.getChunkCount() == 2 );
+        UT_CHECK_OUTPUT( TrimPool.getChunkCount() < spike_chunks );
+        UT_CHECK_OUTPUT( TrimPool.getFreeBlockCount() == TrimPool.getBlockCount() - 1 );
+        TrimPool.dealloc( trim_array[ 10000 ] );
+        TrimPool.trim();
+        UT_CHECK_OUTPUT( TrimPool.getChunkCount() == 1 );
+
+        // The capacity is kept and can be used again
+        bool refill_ok = true;
+        for( uint32_t i = 0; i < 20000; i++ ) {
+            trim_array[ i ] = TrimPool.alloc();
+            if( trim_array[ i ] == NULL ) refill_ok = false;
+            else memset( trim_array[ i ], 0x11, 200 );
+        }
+        UT_CHECK_OUTPUT( refill_ok );
+        TrimPool.deallocBatch( trim_array, 20000 );
+    }
+
+    UT_COMMENT( "Single chunk malloc pool gives its pages back once empty\n" );
+    {
+        MemoryPool SingleChunkPool( 1024, 4096 );
+        for( uint32_t i = 0; i < 4096; i++ ) {
+            trim_array[ i ] = SingleChunkPool.alloc();
+            memset( trim_array[ i ], 0x33, 1024 );
+        }
+        uint32_t rss_full = getResidentKb();
+        for( uint32_t i = 0; i < 4096; i++ ) {
+            SingleChunkPool.dealloc( trim_array[ i ] );
+        }
+        // Nothing is released while a block is in use
+        void* kept_ptr = SingleChunkPool.alloc();
+        UT_CHECK_OUTPUT( SingleChunkPool.trim() == 0 );
+        SingleChunkPool.dealloc( kept_ptr );
+        UT_CHECK_OUTPUT( SingleChunkPool.trim() >= 4000 * 1024 );
+        uint32_t rss_trimmed = getResidentKb();
+        UT_COMMENT( "RSS full " << rss_full << " kB, trimmed " << rss_trimmed << " kB\n" );
+        UT_CHECK_OUTPUT( SingleChunkPool.getChunkCount() == 1 );
+        // Carving starts again from the first block
+        UT_CHECK_OUTPUT( SingleChunkPool.alloc() ==
+            ( uint8_t* )SingleChunkPool.getPoolPtr() + SIZE_MEM_BLOCK_HEADER );
+        UT_CHECK_OUTPUT( SingleChunkPool.getFreeBlockCount() == 4095 );
+    }
+
+    UT_COMMENT( "Trim of a manager skips pools of other owner threads\n" );
+    {
+        MemPoolManager TrimManager;
+        MemoryPool* owned_pool = new MemoryPool( 1024, 1024 );
+        TrimManager.addPool( owned_pool );
+        void* owned_ptr = owned_pool->alloc();
+        memset( owned_ptr, 0, 1024 );
+        owned_pool->dealloc( owned_ptr );
+        std::thread owner_thread( [ owned_pool ] () { owned_pool->setOwnerThread(); } );
+        owner_thread.join();
+        UT_CHECK_OUTPUT( TrimManager.trim() == 0 );
+    }
+
+    UT_COMMENT( "Automatic trim below the watermark\n" );
+    MemPoolConfigStr watermark_config;
+    watermark_config.growth = MemPoolConfigStr::GROWTH_FIXED;
+    watermark_config.growth_blocks = 1000;
+    watermark_config.trim_watermark = 10;
+    MemoryPool WatermarkPool( 1024, 1000, watermark_config );
+    uint32_t rss_before = getResidentKb();
+    for( uint32_t i = 0; i < 20000; i++ ) {
+        trim_array[ i ] = WatermarkPool.alloc();
+        memset( trim_array[ i ], 0x22, 1024 );
+    }
+    uint32_t rss_peak = getResidentKb();
+    UT_CHECK_OUTPUT( WatermarkPool.getChunkCount() == 20 );
+    for( uint32_t i = 20000; i > 0; i-- ) {
+        WatermarkPool.dealloc( trim_array[ i - 1 ] );
+    }
+    uint32_t rss_after = getResidentKb();
+    // Trimmed once usage fell below 2000 blocks; the first two chunks
+    // were still in use at that point
+    UT_CHECK_OUTPUT( WatermarkPool.getChunkCount() == 2 );
+    UT_COMMENT( "RSS before spike " << rss_before << " kB, at peak " << rss_peak <<
+        " kB, after trim " << rss_after << " kB\n" );
+    delete[] trim_array;
+
+    UT_END_STEP;
+
+/* ------------------------------
+   TC step 21
+
+   MemoryPool: deallocation from
+   other threads
+   ------------------------------ */
+
+    UT_START_STEP( 21 );
+
+    MemoryPool OwnedPool( 64, 1000 );
+    OwnedPool.setOwnerThread();
+    void* owned_array[ 1000 ];
+    for( uint32_t i = 0; i < 1000; i++ ) {
+        owned_array[ i ] = OwnedPool.alloc();
+    }
+    UT_CHECK_OUTPUT( OwnedPool.isExhausted() );
+    std::thread remote_freer( [ &OwnedPool, &owned_array ]() {
+        for( uint32_t i = 0; i < 1000; i += 2 ) {
+            OwnedPool.dealloc( owned_array[ i ] );
+        }
+    } );
+    remote_freer.join();
+    // The frees wait in the queue until the owner needs them
+    UT_CHECK_OUTPUT( OwnedPool.getUsedBlockCount() == 1000 );
+    UT_CHECK_OUTPUT( !OwnedPool.isExhausted() );
+    void* reused_ptr = OwnedPool.alloc();
+    UT_CHECK_OUTPUT( reused_ptr == owned_array[ 998 ] );
+    UT_CHECK_OUTPUT( OwnedPool.getUsedBlockCount() == 501 );
+    UT_CHECK_OUTPUT( OwnedPool.getFreeBlockCount() == 499 );
+    // The owner itself frees directly into the free list
+    OwnedPool.dealloc( owned_array[ 1 ] );
+    UT_CHECK_OUTPUT( OwnedPool.alloc() == owned_array[ 1 ] );
+    UT_CHECK_OUTPUT( OwnedPool.drainRemoteFrees() == 0 );
+
+    UT_COMMENT( "Producer allocates, consumer frees " << kHandoverCount <<
+        " blocks:\n" );
+    RemoteFreePool RemotePool( 64, kRingSize + 1 );
+    LockedMemoryPool HandoverLockedPool( 64, kRingSize + 1 );
+    uint32_t remote_ms = runHandover( &RemotePool );
+    RemotePool.getPool()->drainRemoteFrees();
+    UT_CHECK_OUTPUT( RemotePool.getPool()->getUsedBlockCount() == 0 );
+    UT_CHECK_OUTPUT( RemotePool.getPool()->getFreeBlockCount() == kRingSize + 1 );
+    uint32_t handover_locked_ms = runHandover( &HandoverLockedPool );
+    UT_COMMENT( "remote free queue " << remote_ms << " ms, locked pool " <<
+        handover_locked_ms << " ms\n" );
+
+    UT_END_STEP;
+
+/* ------------------------------
+   TC step 22
+
+   CompactMemoryPool: 4- and 8-byte
+   blocks linked by index
+   ------------------------------ */
+
+    UT_START_STEP( 22 );
+
+    CompactMemoryPool HandlePool( 4, 100000 );
+    UT_CHECK_OUTPUT( HandlePool.getBlockStride() == 4 );
+    uint32_t* handle_ptr[ 100 ];
+    for( uint32_t i = 0; i < 100; i++ ) {
+        handle_ptr[ i ] = ( uint32_t* )HandlePool.alloc();
+        *handle_ptr[ i ] = i;
+    }
+    // Blocks are carved back to back without headers
+    UT_CHECK_OUTPUT( ( uint8_t* )handle_ptr[ 99 ] - ( uint8_t* )handle_ptr[ 0 ] == 99 * 4 );
+    UT_CHECK_OUTPUT( HandlePool.getBlockIndex( handle_ptr[ 42 ] ) == 42 );
+    UT_CHECK_OUTPUT( HandlePool.getBlock( 42 ) == handle_ptr[ 42 ] );
+    UT_CHECK_OUTPUT( HandlePool.contains( handle_ptr[ 99 ] ) );
+    UT_CHECK_OUTPUT( !HandlePool.contains( &handle_ptr[ 0 ] ) );
+    HandlePool.dealloc( handle_ptr[ 10 ] );
+    HandlePool.dealloc( handle_ptr[ 20 ] );
+    UT_CHECK_OUTPUT( !HandlePool.isAllocated( handle_ptr[ 10 ] ) );
+    UT_CHECK_OUTPUT( HandlePool.isAllocated( handle_ptr[ 11 ] ) );
+    UT_CHECK_OUTPUT( HandlePool.getUsedBlockCount() == 98 );
+    // Last freed block is reused first
+    UT_CHECK_OUTPUT( HandlePool.alloc() == handle_ptr[ 20 ] );
+    UT_CHECK_OUTPUT( HandlePool.alloc() == handle_ptr[ 10 ] );
+    bool values_ok = true;
+    for( uint32_t i = 0; i < 100; i++ ) {
+        if( i != 10 && i != 20 && *handle_ptr[ i ] != i ) values_ok = false;
+    }
+    UT_CHECK_OUTPUT( values_ok );
+
+    CompactMemoryPool SmallPool( 6, 3 );
+    UT_CHECK_OUTPUT( SmallPool.getBlockStride() == 8 );
+    SmallPool.alloc();
+    SmallPool.alloc();
+    SmallPool.alloc();
+    UT_CHECK_OUTPUT( SmallPool.alloc() == NULL );
+    UT_CHECK_OUTPUT( SmallPool.getFreeBlockCount() == 0 );
+
+    UT_COMMENT( "100 x alloc/dealloc of 100000 8-byte blocks:\n" );
+    {
+        CompactMemoryPool CompactPool( 8, 100000 );
+        MemoryPool PlainPool( 8, 100000 );
+        void** compact_array = new void*[ 100000 ];
+        Timer timer = Timer();
+        for( uint32_t l = 0; l < 100; l++ ) {
+            for( uint32_t i = 0; i < 100000; i++ ) compact_array[ i ] = CompactPool.alloc();
+            for( uint32_t i = 0; i < 100000; i++ ) CompactPool.dealloc( compact_array[ i ] );
+        }
+        uint32_t compact_ms = timer.getElapsed();
+        timer = Timer();
+        for( uint32_t l = 0; l < 100; l++ ) {
+            for( uint32_t i = 0; i < 100000; i++ ) compact_array[ i ] = PlainPool.alloc();
+            for( uint32_t i = 0; i < 100000; i++ ) PlainPool.dealloc( compact_array[ i ] );
+        }
+        uint32_t plain_ms = timer.getElapsed();
+        UT_CHECK_OUTPUT( CompactPool.getUsedBlockCount() == 0 );
+        UT_COMMENT( "compact pool " << compact_ms << " ms (" <<
+            CompactPool.getBlockStride() << " bytes per block), memory pool " <<
+            plain_ms << " ms (" << PlainPool.getBlockStride() << " bytes per block)\n" );
+        delete[] compact_array;
+    }
+
+    UT_END_STEP;
+
+/* ------------------------------
+   TC step 23
+
+   CompactMemoryPool: snapshot in a
+   memory mapped file
+   ------------------------------ */
+
+    UT_START_STEP( 23 );
+
+    // Nodes of a list linked by block index, so they survive remapping
+    struct SnapshotNodeStr {
+        uint32_t next;
+        uint32_t value;
+    };
+    const char* snapshot_path = "mem_pool_snapshot.bin";
+    uint32_t node_layout[ 3 ] = { ( uint32_t )sizeof( SnapshotNodeStr ),
+        ( uint32_t )offsetof( SnapshotNodeStr, next ),
+        ( uint32_t )offsetof( SnapshotNodeStr, value ) };
+    uint64_t node_hash = CompactMemoryPool::hashLayout( node_layout, sizeof( node_layout ) );
+    uint32_t list_head = CompactMemoryPool::kNullIndex;
+    remove( snapshot_path );
+    {
+        CompactMemoryPool SnapshotPool( sizeof( SnapshotNodeStr ), 10000,
+            snapshot_path, 1, node_hash );
+        UT_CHECK_OUTPUT( SnapshotPool.isFileBacked() );
+        UT_CHECK_OUTPUT( !SnapshotPool.isRestored() );
+        for( uint32_t i = 0; i < 1000; i++ ) {
+            SnapshotNodeStr* node_ptr = ( SnapshotNodeStr* )SnapshotPool.alloc();
+            node_ptr->value = i;
+            node_ptr->next = list_head;
+            list_head = SnapshotPool.getBlockIndex( node_ptr );
+        }
+        // Leave a hole in the free list
+        SnapshotPool.dealloc( SnapshotPool.alloc() );
+    }
+    {
+        CompactMemoryPool SnapshotPool( sizeof( SnapshotNodeStr ), 10000,
+            snapshot_path, 1, node_hash );
+        UT_CHECK_OUTPUT( SnapshotPool.isRestored() );
+        UT_CHECK_OUTPUT( SnapshotPool.getUsedBlockCount() == 1000 );
+        uint32_t expected = 1000;
+        bool list_ok = true;
+        for( uint32_t index = list_head; index != CompactMemoryPool::kNullIndex; ) {
+            SnapshotNodeStr* node_ptr = ( SnapshotNodeStr* )SnapshotPool.getBlock( index );
+            if( node_ptr->value != --expected || !SnapshotPool.isAllocated( node_ptr ) ) {
+                list_ok = false;
+            }
+            index = node_ptr->next;
+        }
+        UT_CHECK_OUTPUT( list_ok && expected == 0 );
+        UT_CHECK_OUTPUT( SnapshotPool.getBlockIndex( SnapshotPool.alloc() ) == 1000 );
+    }
+    {
+        CompactMemoryPool SnapshotPool( sizeof( SnapshotNodeStr ), 10000,
+            snapshot_path, 2, node_hash );
+        UT_COMMENT( "Version changed, snapshot discarded\n" );
+        UT_CHECK_OUTPUT( !SnapshotPool.isRestored() );
+        UT_CHECK_OUTPUT( SnapshotPool.getUsedBlockCount() == 0 );
+        UT_CHECK_OUTPUT( !SnapshotPool.isAllocated( SnapshotPool.getBlock( 0 ) ) );
+    }
+    {
+        CompactMemoryPool SnapshotPool( sizeof( SnapshotNodeStr ), 10000,
+            snapshot_path, 2, node_hash + 1 );
+        UT_COMMENT( "Layout changed, snapshot discarded\n" );
+        UT_CHECK_OUTPUT( !SnapshotPool.isRestored() );
+    }
+    {
+        CompactMemoryPool SnapshotPool( sizeof( SnapshotNodeStr ), 20000,
+            snapshot_path, 2, node_hash + 1 );
+        UT_COMMENT( "Block count changed, snapshot discarded\n" );
+        UT_CHECK_OUTPUT( !SnapshotPool.isRestored() );
+    }
+
+    UT_COMMENT( "A process dying after sync leaves a clean snapshot\n" );
+    remove( snapshot_path );
+    pid_t child = fork();
+    if( child == 0 ) {
+        // Never destroyed: the process dies without syncing again
+        CompactMemoryPool* crash_pool = new CompactMemoryPool( sizeof( SnapshotNodeStr ), 10000,
+            snapshot_path, 1, node_hash );
+        for( uint32_t i = 0; i < 100; i++ ) {
+            crash_pool->alloc();
+        }
+        crash_pool->sync();
+        _exit( 0 );
+    }
+    int child_status = 0;
+    UT_CHECK_OUTPUT( waitpid( child, &child_status, 0 ) == child && WIFEXITED( child_status ) );
+    {
+        CompactMemoryPool SnapshotPool( sizeof( SnapshotNodeStr ), 10000,
+            snapshot_path, 1, node_hash );
+        UT_CHECK_OUTPUT( SnapshotPool.isRestored() && SnapshotPool.getUsedBlockCount() == 100 );
+    }
+
+    UT_COMMENT( "A process dying between syncs leaves a dirty snapshot\n" );
+    child = fork();
+    if( child == 0 ) {
+        CompactMemoryPool* crash_pool = new CompactMemoryPool( sizeof( SnapshotNodeStr ), 10000,
+            snapshot_path, 1, node_hash );
+        for( uint32_t i = 0; i < 50; i++ ) {
+            crash_pool->dealloc( crash_pool->getBlock( i ) );
+        }
+        crash_pool->alloc();
+        _exit( 0 );
+    }
+    UT_CHECK_OUTPUT( waitpid( child, &child_status, 0 ) == child && WIFEXITED( child_status ) );
+    {
+        CompactMemoryPool SnapshotPool( sizeof( SnapshotNodeStr ), 10000,
+            snapshot_path, 1, node_hash );
+        UT_CHECK_OUTPUT( !SnapshotPool.isRestored() && SnapshotPool.getUsedBlockCount() == 0 );
+        UT_CHECK_OUTPUT( SnapshotPool.getBlockIndex( SnapshotPool.alloc() ) == 0 );
+    }
+
+    UT_COMMENT( "Pool state out of range, snapshot discarded\n" );
+    {
+        FILE* snapshot_file = fopen( snapshot_path, "r+b" );
+        // bump_index is the 7th word of the header
+        uint32_t bad_bump_index = 10001;
+        UT_CHECK_OUTPUT( snapshot_file != NULL &&
+            fseek( snapshot_file, 6 * sizeof( uint32_t ), SEEK_SET ) == 0 &&
+            fwrite( &bad_bump_index, sizeof( uint32_t ), 1, snapshot_file ) == 1 );
+        fclose( snapshot_file );
+        CompactMemoryPool SnapshotPool( sizeof( SnapshotNodeStr ), 10000,
+            snapshot_path, 1, node_hash );
+        UT_CHECK_OUTPUT( !SnapshotPool.isRestored() && SnapshotPool.getUsedBlockCount() == 0 );
+    }
+    remove( snapshot_path );
+
+    UT_END_STEP;
+
+/* ------------------------------
+   TC step 24
+
+   Pool counters, MemPoolManager
+   telemetry and tag budgets
+   ------------------------------ */
+
+    UT_START_STEP( 24 );
+
+    MemoryPool CountedPool( 32, 100 );
+    void* counted_array[ 100 ];
+    for( uint32_t i = 0; i < 100; i++ ) {
+        counted_array[ i ] = CountedPool.alloc();
+    }
+    for( uint32_t i = 0; i < 60; i++ ) {
+        CountedPool.dealloc( counted_array[ i ] );
+    }
+    UT_CHECK_OUTPUT( CountedPool.getUsedBlockCount() == 40 );
+    UT_CHECK_OUTPUT( CountedPool.getFreeBlockCount() == 60 );
+    UT_CHECK_OUTPUT( CountedPool.getPeakUsedBlockCount() == 100 );
+    CountedPool.resetPeak();
+    UT_CHECK_OUTPUT( CountedPool.getPeakUsedBlockCount() == 40 );
+    UT_CHECK_OUTPUT( CountedPool.allocBatch( counted_array, 70 ) == 60 );
+    UT_CHECK_OUTPUT( CountedPool.getFailedAllocCount() == 10 );
+    UT_CHECK_OUTPUT( CountedPool.getFreeBlockCount() == 0 );
+
+    enum { TAG_RENDERER = 1, TAG_LISTS = 2 };
+    MemPoolManager TelemetryManager;
+    TelemetryManager.addPool( new MemoryPool( 16, 10 ) );
+    TelemetryManager.addPool( new MemoryPool( 64, 10 ) );
+    UT_CHECK_OUTPUT( TelemetryManager.setTelemetry( true ) );
+    TelemetryManager.setTagName( TAG_RENDERER, "renderer" );
+    TelemetryManager.setTagName( TAG_LISTS, "lists" );
+    TelemetryManager.setTagBudget( TAG_LISTS, 5 * 16 );
+    void* tagged_array[ 20 ];
+    for( uint32_t i = 0; i < 12; i++ ) {
+        // Two requests fall through to the 64 byte pool
+        tagged_array[ i ] = TelemetryManager.alloc( 12, TAG_LISTS );
+    }
+    for( uint32_t i = 12; i < 20; i++ ) {
+        tagged_array[ i ] = TelemetryManager.alloc( 40, TAG_RENDERER );
+    }
+    UT_CHECK_OUTPUT( TelemetryManager.alloc( 64 ) == NULL );
+
+    MemPoolStatsStr pool_stats;
+    TelemetryManager.getStats( pool_stats );
+    UT_CHECK_OUTPUT( pool_stats.live_blocks == 20 );
+    UT_CHECK_OUTPUT( pool_stats.live_bytes == 10 * 16 + 10 * 64 );
+    UT_CHECK_OUTPUT( pool_stats.fallthroughs == 2 );
+    UT_CHECK_OUTPUT( pool_stats.failed_allocs == 1 );
+    UT_CHECK_OUTPUT( pool_stats.requested_bytes == 12 * 12 + 8 * 40 );
+    UT_CHECK_OUTPUT( pool_stats.wasted_bytes == pool_stats.live_bytes - pool_stats.requested_bytes );
+
+    MemPoolTagStatsStr tag_stats;
+    TelemetryManager.getTagStats( TAG_LISTS, tag_stats );
+    UT_CHECK_OUTPUT( tag_stats.live_blocks == 12 );
+    UT_CHECK_OUTPUT( tag_stats.live_bytes == 10 * 16 + 2 * 64 );
+    // Every allocation after the fifth went over the budget
+    UT_CHECK_OUTPUT( tag_stats.over_budget_allocs == 7 );
+    TelemetryManager.getTagStats( TAG_RENDERER, tag_stats );
+    UT_CHECK_OUTPUT( tag_stats.live_bytes == 8 * 64 && tag_stats.over_budget_allocs == 0 );
+
+    for( uint32_t i = 0; i < 20; i++ ) {
+        TelemetryManager.dealloc( tagged_array[ i ] );
+    }
+    TelemetryManager.getStats( pool_stats );
+    UT_CHECK_OUTPUT( pool_stats.live_blocks == 0 && pool_stats.peak_blocks == 20 );
+    TelemetryManager.getTagStats( TAG_LISTS, tag_stats );
+    UT_CHECK_OUTPUT( tag_stats.live_bytes == 0 && tag_stats.peak_bytes == 10 * 16 + 2 * 64 );
+    TelemetryManager.resetPeaks();
+    TelemetryManager.getStats( pool_stats );
+    UT_CHECK_OUTPUT( pool_stats.peak_blocks == 0 );
+    TelemetryManager.logStats( stdout );
+
+    UT_COMMENT( "Blocks allocated before enabling are not counted\n" );
+    TelemetryManager.setTelemetry( false );
+    void* untracked_ptr = TelemetryManager.alloc( 16 );
+    TelemetryManager.setTelemetry( true );
+    TelemetryManager.dealloc( untracked_ptr );
+    TelemetryManager.getStats( pool_stats );
+    UT_CHECK_OUTPUT( pool_stats.live_blocks == 0 && pool_stats.live_bytes == 0 );
+
+    UT_COMMENT( "Blocks live across a telemetry toggle are released once\n" );
+    void* carried_ptr = TelemetryManager.alloc( 16, TAG_LISTS );
+    void* freed_off_ptr = TelemetryManager.alloc( 16, TAG_LISTS );
+    TelemetryManager.setTelemetry( false );
+    TelemetryManager.dealloc( freed_off_ptr );
+    TelemetryManager.setTelemetry( true );
+    TelemetryManager.getStats( pool_stats );
+    UT_CHECK_OUTPUT( pool_stats.live_blocks == 1 && pool_stats.live_bytes == 16 );
+    UT_CHECK_OUTPUT( pool_stats.peak_blocks == 1 );
+    TelemetryManager.dealloc( carried_ptr );
+    TelemetryManager.getStats( pool_stats );
+    UT_CHECK_OUTPUT( pool_stats.live_blocks == 0 && pool_stats.live_bytes == 0 );
+    TelemetryManager.getTagStats( TAG_LISTS, tag_stats );
+    UT_CHECK_OUTPUT( tag_stats.live_blocks == 0 && tag_stats.live_bytes == 0 );
+
+    MemPoolManager AlignedTelemetryManager( MemPoolConfigStr::LAYOUT_ALIGNED );
+    UT_CHECK_OUTPUT( !AlignedTelemetryManager.setTelemetry( true ) );
+
+    UT_END_STEP;
+
 /* ------------------------------ */
     return;
 }
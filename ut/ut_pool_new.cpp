@@ -0,0 +1,227 @@
+/******************************************************************************/
+/**
+    Test script for the pool backed operator new ( Testocore project )
+    Copyright (C) 2013 Pekka Mkinen
+    makinpek [ at ] gmail
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+/******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fstream>
+#include <string>
+#include <sstream>
+#include <list>
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+// Testocore headers:
+#include "mem_pool.h"
+#include "pool_new.h"
+#include "timer.h"
+#include "ut.h"
+
+class TestCase : public TestCaseBase {
+    public:
+    TestCase( const char* name ) : TestCaseBase( name ) {}
+    ~TestCase() { }
+    void runTest();
+};
+
+// Objects are created in one thread and deleted in another
+static std::atomic< int* > g_HandoverSlot( NULL );
+static const uint32_t kHandoverCount = 20000;
+
+static void handoverProducer( void ) {
+    for( uint32_t i = 0; i < kHandoverCount; i++ ) {
+        int* ptr = new int( i );
+        int* expected = NULL;
+        while( !g_HandoverSlot.compare_exchange_weak( expected, ptr ) ) {
+            expected = NULL;
+            std::this_thread::yield();
+        }
+    }
+}
+
+static void handoverConsumer( uint32_t* sum_ptr ) {
+    uint32_t sum = 0;
+    for( uint32_t i = 0; i < kHandoverCount; i++ ) {
+        int* ptr = NULL;
+        while( ( ptr = g_HandoverSlot.exchange( NULL ) ) == NULL ) {
+            std::this_thread::yield();
+        }
+        sum += *ptr;
+        delete ptr;
+    }
+    *sum_ptr = sum;
+}
+
+int main( void ) {
+
+    TestCase TC( "ut_pool_new" );
+
+    TC.execute();
+
+    return 0;
+}
+
+/* -----------------------------------------------------------------------------
+ * Define test script here.
+ */
+void TestCase::runTest( void ) {
+
+/* ------------------------------
+   TC step 1
+
+   Routing of the replaced operators
+   ------------------------------ */
+
+    UT_START_STEP( 1 );
+
+    UT_COMMENT( "Small requests come from the pools, 16 byte aligned\n" );
+    bool small_ok = true;
+    for( uint32_t size = 1; size <= kPoolNewMaxBytes; size += 7 ) {
+        char* ptr = new char[ size ];
+        memset( ptr, 0x5a, size );
+        if( !isPoolNewBlock( ptr ) || ( uintptr_t )ptr % 16 != 0 ) {
+            small_ok = false;
+        }
+        delete[] ptr;
+    }
+    UT_CHECK_OUTPUT( small_ok );
+
+    UT_COMMENT( "Large requests come from the system allocator\n" );
+    char* large_ptr = new char[ kPoolNewMaxBytes + 1 ];
+    UT_CHECK_OUTPUT( !isPoolNewBlock( large_ptr ) );
+    UT_CHECK_OUTPUT( ( uintptr_t )large_ptr % 16 == 0 );
+    delete[] large_ptr;
+
+    UT_COMMENT( "nothrow variants and std::string\n" );
+    double* double_ptr = new( std::nothrow ) double( 1.5 );
+    UT_CHECK_OUTPUT( double_ptr != NULL && isPoolNewBlock( double_ptr ) );
+    delete double_ptr;
+    std::string* string_ptr = new std::string( "pooled string that needs its own buffer" );
+    UT_CHECK_OUTPUT( isPoolNewBlock( string_ptr ) );
+    delete string_ptr;
+
+    UT_COMMENT( "Blocks move between threads\n" );
+    uint32_t sum = 0;
+    std::thread producer( handoverProducer );
+    std::thread consumer( handoverConsumer, &sum );
+    producer.join();
+    consumer.join();
+    UT_CHECK_OUTPUT( sum == ( uint32_t )( ( uint64_t )kHandoverCount * ( kHandoverCount - 1 ) / 2 ) );
+
+    UT_END_STEP;
+
+/* ------------------------------
+   TC step 2
+
+   Benchmark: small object new/delete
+   ------------------------------ */
+
+    UT_START_STEP( 2 );
+
+    uint32_t rounds = 2000;
+    const uint32_t batch = 1000;
+    void* ptr_array[ batch ];
+    UT_COMMENT( rounds << " rounds of " << batch <<
+        " allocations and frees of 8..256 bytes:\n" );
+
+    Timer timer = Timer();
+    for( uint32_t r = 0; r < rounds; r++ ) {
+        for( uint32_t i = 0; i < batch; i++ ) {
+            ptr_array[ i ] = new char[ 8 + ( i * 37 ) % 249 ];
+        }
+        for( uint32_t i = 0; i < batch; i++ ) {
+            delete[] ( char* )ptr_array[ i ];
+        }
+    }
+    UT_COMMENT( "pool new/delete:\t" << timer.getElapsed() << " ms\n" );
+
+    timer = Timer();
+    for( uint32_t r = 0; r < rounds; r++ ) {
+        for( uint32_t i = 0; i < batch; i++ ) {
+            ptr_array[ i ] = malloc( 8 + ( i * 37 ) % 249 );
+        }
+        for( uint32_t i = 0; i < batch; i++ ) {
+            free( ptr_array[ i ] );
+        }
+    }
+    UT_COMMENT( "malloc/free:\t" << timer.getElapsed() << " ms\n" );
+
+    // Node based container churn goes through operator new
+    timer = Timer();
+    for( uint32_t r = 0; r < 20; r++ ) {
+        std::list< int > list;
+        for( uint32_t i = 0; i < 100000; i++ ) list.push_back( i );
+    }
+    UT_COMMENT( "std::list, 20 x 100000 push_back:\t" << timer.getElapsed() << " ms\n" );
+
+    UT_END_STEP;
+
+/* ------------------------------
+   TC step 3
+
+   Another thread caching manager
+   alongside new/delete
+   ------------------------------ */
+
+    UT_START_STEP( 3 );
+
+    UT_COMMENT( "Alternating a caching manager with new/delete\n" );
+    {
+        MemPoolManager CachingManager;
+        CachingManager.addPool( new MemoryPool( 32, 256 ) );
+        CachingManager.setThreadCaching( true );
+        bool alternate_ok = true;
+        for( uint32_t i = 0; i < 1000; i++ ) {
+            void* block_ptr = CachingManager.alloc( 16 );
+            int* int_ptr = new int( i );
+            if( block_ptr == NULL || !isPoolNewBlock( int_ptr ) || *int_ptr != ( int )i ) {
+                alternate_ok = false;
+            }
+            CachingManager.dealloc( block_ptr );
+            delete int_ptr;
+        }
+        UT_CHECK_OUTPUT( alternate_ok );
+    }
+
+    UT_COMMENT( "Same in another thread\n" );
+    {
+        MemPoolManager CachingManager;
+        CachingManager.addPool( new MemoryPool( 32, 256 ) );
+        CachingManager.setThreadCaching( true );
+        bool alternate_ok = true;
+        std::thread worker( [ &CachingManager, &alternate_ok ] () {
+            for( uint32_t i = 0; i < 1000; i++ ) {
+                void* block_ptr = CachingManager.alloc( 16 );
+                std::string* string_ptr = new std::string( "alternating with a caching manager" );
+                if( block_ptr == NULL || !isPoolNewBlock( string_ptr ) ) {
+                    alternate_ok = false;
+                }
+                delete string_ptr;
+                CachingManager.dealloc( block_ptr );
+            }
+        } );
+        worker.join();
+        UT_CHECK_OUTPUT( alternate_ok );
+    }
+
+    UT_END_STEP;
+
+/* ------------------------------ */
+    return;
+}